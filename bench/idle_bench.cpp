@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t kWorkers{4};
+constexpr std::size_t kBursts{500};
+constexpr std::size_t kBurstSize{8};
+// idle gap between bursts: long enough for workers to run out of spins
+constexpr std::chrono::microseconds kGap{200};
+
+struct Result {
+  double p50_us{0};
+  double p99_us{0};
+  // CPU time of the process per second of wall time
+  double cpu_load{0};
+};
+
+/**
+ * Post bursts of tasks separated by idle gaps and measure time from post
+ * to the start of execution of the burst's tasks.
+ */
+Result Run(const klyaksa::IdleStrategy& idle) {
+  klyaksa::ThreadPool executor{kWorkers, {.idle = idle}};
+  executor.Start();
+  std::vector<double> latencies;
+  latencies.reserve(kBursts * kBurstSize);
+  std::vector<Clock::time_point> started(kBurstSize);
+  std::atomic<std::size_t> done{0};
+
+  const auto cpu_start = std::clock();
+  const auto wall_start = Clock::now();
+  for (std::size_t burst = 0; burst < kBursts; burst++) {
+    std::this_thread::sleep_for(kGap);
+    done.store(0);
+    const auto posted = Clock::now();
+    for (std::size_t i = 0; i < kBurstSize; i++) {
+      (void)Dispatch(executor, [&started, &done, i] {
+        started[i] = Clock::now();
+        done.fetch_add(1, std::memory_order_release);
+      });
+    }
+    while (done.load(std::memory_order_acquire) < kBurstSize) {
+      std::this_thread::yield();
+    }
+    for (auto&& start : started) {
+      latencies.push_back(
+          std::chrono::duration<double, std::micro>(start - posted).count());
+    }
+  }
+  const auto wall =
+      std::chrono::duration<double>(Clock::now() - wall_start).count();
+  const auto cpu =
+      static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+  executor.Stop();
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) {
+    return latencies[static_cast<std::size_t>(p * (latencies.size() - 1))];
+  };
+  return {percentile(0.5), percentile(0.99), cpu / wall};
+}
+
+void Report(std::string_view name, const klyaksa::IdleStrategy& idle) {
+  const auto result = Run(idle);
+  std::cout << std::left << std::setw(20) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(12) << result.p50_us
+            << std::setw(12) << result.p99_us << std::setprecision(2)
+            << std::setw(12) << result.cpu_load << '\n';
+}
+
+}  // namespace
+
+int main() {
+  std::cout << std::left << std::setw(20) << "idle strategy" << std::right
+            << std::setw(12) << "p50, us" << std::setw(12) << "p99, us"
+            << std::setw(12) << "cpu/wall" << '\n';
+  Report("park", {});
+  Report("spin 2000", {.spin = 2'000});
+  Report("spin 20000", {.spin = 20'000});
+  Report("spin+yield", {.spin = 2'000, .yield = 100});
+  Report("adaptive 20000", {.spin = 20'000, .adaptive = true});
+  return 0;
+}
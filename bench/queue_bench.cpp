@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "ccqueue.hpp"
+#include "lfqueue.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t kCapacity{klyaksa::ThreadPool::kTaskQueueSize};
+constexpr std::size_t kTotalItems{1'000'000};
+constexpr std::size_t kConsumers{4};
+
+/**
+ * Push `kTotalItems` split between `producers` threads while `kConsumers`
+ * threads drain the queue of `capacity` elements.
+ * @return throughput in items per second
+ */
+template <class Queue>
+double Run(std::size_t producers, std::size_t capacity) {
+  Queue queue{capacity};
+  queue.Resume();
+  const std::size_t per_producer = kTotalItems / producers;
+
+  std::atomic<std::uint64_t> checksum{0};
+  std::vector<std::jthread> consumers;
+  for (std::size_t i = 0; i < kConsumers; i++) {
+    consumers.emplace_back([&queue, &checksum]() {
+      std::uint64_t local{0};
+      while (auto value = queue.TryPop()) {
+        local += *value;
+      }
+      checksum.fetch_add(local, std::memory_order_relaxed);
+    });
+  }
+
+  const auto start = Clock::now();
+  {
+    std::vector<std::jthread> pushers;
+    for (std::size_t i = 0; i < producers; i++) {
+      pushers.emplace_back([&queue, per_producer]() {
+        for (std::size_t j = 0; j < per_producer; j++) {
+          while (!queue.TryPush(std::uint64_t{1})) {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+  }
+  // consumers drain the rest and leave once the queue is empty
+  queue.Halt();
+  consumers.clear();
+  const auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+
+  if (checksum.load() != per_producer * producers) {
+    std::cerr << "lost elements: " << checksum.load() << " of "
+              << per_producer * producers << '\n';
+  }
+  return static_cast<double>(per_producer * producers) / elapsed.count();
+}
+
+template <class Queue>
+void Report(std::string_view name, std::size_t producers,
+            std::size_t capacity = kCapacity) {
+  std::cout << std::left << std::setw(10) << name << std::right
+            << std::setw(10) << producers << std::setw(10) << kConsumers
+            << std::setw(16) << std::fixed << std::setprecision(0)
+            << Run<Queue>(producers, capacity) << '\n';
+}
+
+}  // namespace
+
+int main() {
+  using Locked = CcQueue<std::uint64_t>;
+  using LockFree = LfQueue<std::uint64_t>;
+
+  std::cout << std::left << std::setw(10) << "queue" << std::right
+            << std::setw(10) << "producers" << std::setw(10) << "consumers"
+            << std::setw(16) << "items/s" << '\n';
+  for (std::size_t producers : {1, 4, 16, 64}) {
+    Report<Locked>("CcQueue", producers);
+    Report<LockFree>("LfQueue", producers);
+    Report<Locked>("Unbounded", producers, Locked::kUnbounded);
+  }
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string_view>
+#include <thread>
+
+#include "thread_pool.hpp"
+
+namespace {
+
+std::atomic<std::uint64_t> allocations{0};
+
+}  // namespace
+
+// count every allocation of the process
+void* operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t kTasks{200'000};
+constexpr std::size_t kWorkers{4};
+
+struct Result {
+  double allocations_per_task{0};
+  double tasks_per_second{0};
+};
+
+/**
+ * Submit `kTasks` by `submit(executor, counter)` from a single thread
+ * to the running pool and wait for all of them.
+ * Warm-up round makes the pool allocate what it needs once.
+ */
+template <class Submit>
+Result Run(Submit&& submit, bool work_stealing) {
+  klyaksa::ThreadPool executor{
+      kWorkers, {.overflow_policy = klyaksa::OverflowPolicy::kCallerRuns,
+                 .work_stealing = work_stealing}};
+  executor.Start();
+  std::atomic<std::size_t> done{0};
+  auto round = [&]() {
+    done.store(0);
+    for (std::size_t i = 0; i < kTasks; i++) {
+      submit(executor, done);
+    }
+    while (done.load() < kTasks) {
+      std::this_thread::yield();
+    }
+  };
+  round();
+
+  const auto allocated = allocations.load();
+  const auto start = Clock::now();
+  round();
+  const auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+  const auto total = allocations.load() - allocated;
+  executor.Stop();
+  return {static_cast<double>(total) / kTasks, kTasks / elapsed.count()};
+}
+
+template <class Submit>
+void Report(std::string_view name, Submit&& submit,
+            bool work_stealing = false) {
+  const auto result = Run(std::forward<Submit>(submit), work_stealing);
+  std::cout << std::left << std::setw(24) << name << std::right
+            << std::setw(14) << std::fixed << std::setprecision(2)
+            << result.allocations_per_task << std::setw(16)
+            << std::setprecision(0) << result.tasks_per_second << '\n';
+}
+
+}  // namespace
+
+int main() {
+  std::cout << std::left << std::setw(24) << "api" << std::right
+            << std::setw(14) << "allocs/task" << std::setw(16) << "tasks/s"
+            << '\n';
+  Report("Post", [](klyaksa::ThreadPool& executor, auto& done) {
+    (void)Post(executor, [&done] { done++; });
+  });
+  Report("Dispatch", [](klyaksa::ThreadPool& executor, auto& done) {
+    (void)Dispatch(executor, [&done] { done++; });
+  });
+  Report("Dispatch (bound args)", [](klyaksa::ThreadPool& executor,
+                                     auto& done) {
+    (void)Dispatch(
+        executor, [](auto& counter, int step) { counter += step; },
+        std::ref(done), 1);
+  });
+  Report("Dispatch (64B capture)", [](klyaksa::ThreadPool& executor,
+                                      auto& done) {
+    std::array<std::uint64_t, 8> payload{1};
+    (void)Dispatch(executor, [&done, payload] { done += payload[0]; });
+  });
+  // a task posted by a worker goes to its own deque in work-stealing mode
+  Report(
+      "Dispatch (from a task)",
+      [](klyaksa::ThreadPool& executor, auto& done) {
+        (void)Dispatch(executor, [&executor, &done] {
+          (void)Dispatch(executor, [&done] { done++; });
+        });
+      },
+      true);
+  return 0;
+}
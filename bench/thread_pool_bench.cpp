@@ -0,0 +1,192 @@
+// Prints results as a single JSON object so runs of different commits can be
+// compared by a script
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t kThroughputTasks{200'000};
+constexpr std::size_t kLatencySamples{2'000};
+constexpr std::size_t kFanOuts{500};
+constexpr std::size_t kFanOutWidth{64};
+constexpr std::size_t kStartStopCycles{200};
+
+double Seconds(Clock::duration elapsed) {
+  return std::chrono::duration<double>(elapsed).count();
+}
+
+// producers never lose tasks: they wait for a free slot
+klyaksa::ThreadPoolOptions Blocking() {
+  return {.overflow_policy = klyaksa::OverflowPolicy::kBlock,
+          .block_timeout = std::chrono::seconds{10}};
+}
+
+void WaitFor(const std::atomic<std::size_t>& counter, std::size_t expected) {
+  while (counter.load(std::memory_order_acquire) < expected) {
+    std::this_thread::yield();
+  }
+}
+
+/**
+ * Empty tasks posted by `producers` threads
+ * @return tasks per second from the first post to the last execution
+ */
+double Throughput(std::size_t producers, std::size_t workers,
+                  bool with_future) {
+  klyaksa::ThreadPool executor{workers, Blocking()};
+  executor.Start();
+  std::atomic<std::size_t> done{0};
+  const auto per_producer = kThroughputTasks / producers;
+  const auto start = Clock::now();
+  {
+    std::vector<std::jthread> threads;
+    for (std::size_t i = 0; i < producers; i++) {
+      threads.emplace_back([&executor, &done, per_producer, with_future]() {
+        auto task = [&done] { done.fetch_add(1, std::memory_order_release); };
+        for (std::size_t j = 0; j < per_producer; j++) {
+          if (with_future) {
+            (void)Post(executor, task);
+          } else {
+            (void)Dispatch(executor, task);
+          }
+        }
+      });
+    }
+  }
+  WaitFor(done, per_producer * producers);
+  const auto elapsed = Seconds(Clock::now() - start);
+  executor.Stop();
+  return static_cast<double>(per_producer * producers) / elapsed;
+}
+
+// post-to-run latency of tasks posted one by one to idle workers
+klyaksa::HistogramSnapshot Latency() {
+  klyaksa::ThreadPool executor{4, {.collect_timings = true}};
+  executor.Start();
+  std::atomic<std::size_t> done{0};
+  for (std::size_t i = 0; i < kLatencySamples; i++) {
+    (void)Dispatch(executor,
+                   [&done] { done.fetch_add(1, std::memory_order_release); });
+    WaitFor(done, i + 1);
+    std::this_thread::sleep_for(std::chrono::microseconds{50});
+  }
+  executor.Stop();
+  return executor.Snapshot().total.queue_wait;
+}
+
+/**
+ * A task posted from outside posts `kFanOutWidth` children,
+ * the last finished child completes the round
+ * @return rounds per second
+ */
+double FanOut(bool work_stealing) {
+  auto options = Blocking();
+  options.work_stealing = work_stealing;
+  klyaksa::ThreadPool executor{4, options};
+  executor.Start();
+  std::atomic<std::size_t> children{0};
+  std::atomic<std::size_t> rounds{0};
+  const auto start = Clock::now();
+  for (std::size_t round = 0; round < kFanOuts; round++) {
+    children.store(0, std::memory_order_relaxed);
+    (void)Dispatch(executor, [&]() {
+      for (std::size_t i = 0; i < kFanOutWidth; i++) {
+        (void)Dispatch(executor, [&]() {
+          if (children.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+              kFanOutWidth) {
+            rounds.fetch_add(1, std::memory_order_release);
+          }
+        });
+      }
+    });
+    WaitFor(rounds, round + 1);
+  }
+  const auto elapsed = Seconds(Clock::now() - start);
+  executor.Stop();
+  return static_cast<double>(kFanOuts) / elapsed;
+}
+
+// @return microseconds per Start + Stop cycle
+double StartStop(std::size_t workers) {
+  klyaksa::ThreadPool executor{workers};
+  const auto start = Clock::now();
+  for (std::size_t i = 0; i < kStartStopCycles; i++) {
+    executor.Start();
+    executor.Stop();
+  }
+  return Seconds(Clock::now() - start) * 1e6 / kStartStopCycles;
+}
+
+}  // namespace
+
+int main() {
+  std::ostringstream json;
+  json << "{\n";
+#ifdef KLYAKSA_LOCK_FREE_QUEUE
+  json << "  \"queue\": \"LfQueue\",\n";
+#else
+  json << "  \"queue\": \"CcQueue\",\n";
+#endif  // KLYAKSA_LOCK_FREE_QUEUE
+  json << "  \"hardware_concurrency\": "
+       << std::thread::hardware_concurrency() << ",\n";
+
+  json << "  \"throughput\": [";
+  const char* separator = "\n";
+  for (bool with_future : {false, true}) {
+    for (std::size_t producers : {1, 4}) {
+      for (std::size_t workers : {1, 2, 4}) {
+        json << separator << "    {\"api\": \""
+             << (with_future ? "Post" : "Dispatch")
+             << "\", \"producers\": " << producers
+             << ", \"workers\": " << workers << ", \"tasks_per_second\": "
+             << static_cast<std::uint64_t>(
+                    Throughput(producers, workers, with_future))
+             << "}";
+        separator = ",\n";
+      }
+    }
+  }
+  json << "\n  ],\n";
+
+  const auto latency = Latency();
+  json << "  \"latency_ns\": {\"samples\": " << latency.Count()
+       << ", \"mean\": " << static_cast<std::uint64_t>(latency.Mean())
+       << ", \"p50\": " << latency.Percentile(50)
+       << ", \"p90\": " << latency.Percentile(90)
+       << ", \"p99\": " << latency.Percentile(99)
+       << ", \"max\": " << latency.max << "},\n";
+
+  json << "  \"fan_out\": [";
+  separator = "\n";
+  for (bool work_stealing : {false, true}) {
+    json << separator << "    {\"work_stealing\": "
+         << (work_stealing ? "true" : "false")
+         << ", \"width\": " << kFanOutWidth << ", \"rounds_per_second\": "
+         << static_cast<std::uint64_t>(FanOut(work_stealing)) << "}";
+    separator = ",\n";
+  }
+  json << "\n  ],\n";
+
+  json << "  \"start_stop\": [";
+  separator = "\n";
+  for (std::size_t workers : {1, 4, 16}) {
+    const auto cycle = StartStop(workers);
+    json << separator << "    {\"workers\": " << workers
+         << ", \"cycle_us\": " << static_cast<std::uint64_t>(cycle) << "}";
+    separator = ",\n";
+  }
+  json << "\n  ]\n}\n";
+
+  std::cout << json.str();
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "timer_queue.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// deadlines are spread uniformly over this horizon
+constexpr std::chrono::milliseconds kHorizon{10'000};
+// the timer thread checks for expired timers this often
+constexpr std::chrono::milliseconds kStep{1};
+
+struct Result {
+  double inserts_per_second{0};
+  double expiries_per_second{0};
+};
+
+/**
+ * Insert `count` timers with random deadlines and then pop them all
+ * moving simulated time forward by `kStep`
+ */
+Result Run(klyaksa::TimerBackend backend, std::size_t count) {
+  const auto origin = Clock::now();
+  auto timers = klyaksa::MakeTimerQueue(backend, std::chrono::milliseconds{1});
+  std::mt19937_64 random{42};
+  std::uniform_int_distribution<std::int64_t> offset{
+      0, std::chrono::duration_cast<std::chrono::nanoseconds>(kHorizon)
+             .count()};
+  std::vector<klyaksa::Timepoint> deadlines(count);
+  for (auto&& deadline : deadlines) {
+    deadline = origin + std::chrono::nanoseconds{offset(random)};
+  }
+
+  auto start = Clock::now();
+  for (auto deadline : deadlines) {
+    timers->Insert(deadline, klyaksa::Task::Detached([] {}));
+  }
+  const auto inserted = std::chrono::duration<double>(Clock::now() - start);
+
+  std::vector<klyaksa::ExpiredTimer> expired;
+  expired.reserve(count);
+  std::size_t popped = 0;
+  start = Clock::now();
+  for (auto now = origin; popped < count; now += kStep) {
+    timers->PopExpired(now, expired);
+    popped += expired.size();
+    expired.clear();
+  }
+  const auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+  return {static_cast<double>(count) / inserted.count(),
+          static_cast<double>(count) / elapsed.count()};
+}
+
+void Report(std::string_view name, klyaksa::TimerBackend backend,
+            std::size_t count) {
+  const auto result = Run(backend, count);
+  std::cout << std::left << std::setw(10) << name << std::right
+            << std::setw(12) << count << std::fixed << std::setprecision(0)
+            << std::setw(16) << result.inserts_per_second << std::setw(16)
+            << result.expiries_per_second << '\n';
+}
+
+}  // namespace
+
+int main() {
+  std::cout << std::left << std::setw(10) << "backend" << std::right
+            << std::setw(12) << "timers" << std::setw(16) << "inserts/s"
+            << std::setw(16) << "expiries/s" << '\n';
+  for (std::size_t count : {10'000, 1'000'000}) {
+    Report("map", klyaksa::TimerBackend::kMap, count);
+    Report("wheel", klyaksa::TimerBackend::kWheel, count);
+  }
+  return 0;
+}
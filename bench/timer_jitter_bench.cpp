@@ -0,0 +1,82 @@
+// Lateness of timers: time from the deadline to the start of the task
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string_view>
+#include <thread>
+
+#include "scheduler.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t kSamples{2'000};
+// delays are random in this range so deadlines don't align with anything
+constexpr std::chrono::microseconds kMinDelay{100};
+constexpr std::chrono::microseconds kMaxDelay{2'000};
+
+/**
+ * Schedule timers one after another waiting for each to fire
+ * @return lateness in nanoseconds
+ */
+klyaksa::HistogramSnapshot Run(klyaksa::SchedulerOptions options) {
+  // a single worker is the only writer of the histogram
+  klyaksa::ThreadPool pool{1};
+  klyaksa::Scheduler scheduler{&pool, options};
+  pool.Start();
+  scheduler.Start();
+  std::mt19937_64 random{42};
+  std::uniform_int_distribution<std::int64_t> delay{kMinDelay.count(),
+                                                    kMaxDelay.count()};
+  klyaksa::Histogram lateness;
+  std::atomic<std::size_t> fired{0};
+  for (std::size_t i = 0; i < kSamples; i++) {
+    const auto deadline =
+        Clock::now() + std::chrono::microseconds{delay(random)};
+    scheduler.ScheduleAt(deadline, [deadline, &lateness, &fired]() {
+      const auto late = Clock::now() - deadline;
+      lateness.Record(static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(late).count()));
+      fired.fetch_add(1, std::memory_order_release);
+    });
+    while (fired.load(std::memory_order_acquire) <= i) {
+      std::this_thread::yield();
+    }
+  }
+  scheduler.Stop();
+  pool.Stop();
+  return lateness.Snapshot();
+}
+
+void Report(std::string_view name, klyaksa::SchedulerOptions options) {
+  const auto lateness = Run(options);
+  auto us = [](std::uint64_t ns) { return static_cast<double>(ns) / 1e3; };
+  std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(10)
+            << us(lateness.Percentile(50)) << std::setw(10)
+            << us(lateness.Percentile(99)) << std::setw(10)
+            << us(lateness.Percentile(99.9)) << std::setw(10)
+            << us(lateness.max) << '\n';
+}
+
+}  // namespace
+
+int main() {
+  using namespace std::chrono_literals;
+  std::cout << std::left << std::setw(24) << "mode (lateness, us)"
+            << std::right << std::setw(10) << "p50" << std::setw(10) << "p99"
+            << std::setw(10) << "p999" << std::setw(10) << "max" << '\n';
+  Report("map, sleep", {});
+  Report("map, spin 200us", {.spin_threshold = 200us});
+  Report("wheel 1ms, sleep", {.backend = klyaksa::TimerBackend::kWheel});
+  Report("wheel 100us, spin 200us", {.backend = klyaksa::TimerBackend::kWheel,
+                                     .tick = 100us,
+                                     .spin_threshold = 200us});
+  return 0;
+}
@@ -1,33 +1,62 @@
 // Source: https://gist.github.com/Roout/c3be2d97809758c3f6936c6b238c3b3a
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <limits>
 #include <mutex>
 #include <optional>
+#include <span>
+#include <stdexcept>
 #include <type_traits>
+#include <utility>
 
-template <typename T, std::size_t Capacity>
+/**
+ * Mutex-based MPMC queue with capacity chosen at runtime.
+ *
+ * Elements live in linked fixed-size segments which are allocated on demand
+ * and recycled (never freed before the queue dies) once drained, so a small
+ * queue doesn't reserve memory it never uses and `kUnbounded` queue grows
+ * with the load without reallocating elements.
+ */
+template <typename T>
 class CcQueue {
  public:
   static_assert(std::is_move_constructible_v<T>);
   static_assert(std::is_move_assignable_v<T>);
   static_assert(std::is_default_constructible_v<T>);
 
-  static constexpr std::size_t kCapacity{Capacity};
+  // capacity of the queue without limit
+  static constexpr std::size_t kUnbounded{
+      std::numeric_limits<std::size_t>::max()};
+  // number of elements in a segment
+  static constexpr std::size_t kSegmentSize{64};
 
   using element = T;
-  using container = std::array<element, kCapacity>;
 
-  CcQueue() : front_{0}, back_{0}, size_{0}, halt_{true} {
-    assert(front_ == back_);
+  explicit CcQueue(std::size_t capacity) : capacity_{capacity}, halt_{true} {
+    if (capacity_ == 0) {
+      throw std::invalid_argument("CcQueue capacity must be positive");
+    }
+  }
+
+  CcQueue(const CcQueue&) = delete;
+  CcQueue& operator=(const CcQueue&) = delete;
+
+  ~CcQueue() {
+    Release(head_);
+    Release(spare_);
   }
 
   // return true if value was pushed successfully (queue is not full)
   // otherwise return false on failure and doesn't block
-  [[nodiscard]] bool TryPush(element cmd) {
+  // Note: `cmd` is left untouched on failure
+  [[nodiscard]] bool TryPush(element&& cmd) {
     bool is_pushed = false;
     if (std::unique_lock<std::mutex> lock{mutex_}; !IsFull()) {
       PushBack(std::move(cmd));
@@ -39,30 +68,128 @@ class CcQueue {
     return is_pushed;
   }
 
+  [[nodiscard]] bool TryPush(const element& cmd)
+    requires std::is_copy_constructible_v<element>
+  {
+    return TryPush(element{cmd});
+  }
+
+  // push as many elements from the front of `values` as fit
+  // under a single lock and wake up at most that many consumers
+  // return number of pushed elements: the rest are left untouched
+  [[nodiscard]] std::size_t TryPushN(std::span<element> values) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    std::size_t pushed = 0;
+    for (; pushed < values.size() && !IsFull(); pushed++) {
+      PushBack(std::move(values[pushed]));
+    }
+    const std::size_t waiting = waiting_consumers_;
+    lock.unlock();
+    if (pushed >= waiting) {
+      notifier_.notify_all();
+    } else {
+      for (std::size_t i = 0; i < pushed; i++) {
+        notifier_.notify_one();
+      }
+    }
+    return pushed;
+  }
+
+  // return true if value was pushed before timeout expired
+  // otherwise return false: timeout expired or queue was halted while full
+  // Note: `cmd` is left untouched on failure
+  template <class Rep, class Period>
+  [[nodiscard]] bool TryPushFor(
+      element&& cmd, const std::chrono::duration<Rep, Period>& timeout) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    blocked_producers_++;
+    const bool has_room = not_full_.wait_for(
+        lock, timeout, [this]() { return !IsFull() || !halt_; });
+    blocked_producers_--;
+    if (!has_room || IsFull()) {
+      return false;
+    }
+    PushBack(std::move(cmd));
+    lock.unlock();
+    notifier_.notify_one();
+    return true;
+  }
+
+  // push value evicting the front element if queue is full
+  // return evicted element if any
+  std::optional<element> PushEvictOldest(element&& cmd) {
+    std::optional<element> evicted{};
+    std::unique_lock<std::mutex> lock{mutex_};
+    if (IsFull()) {
+      evicted.emplace(PopFront());
+    }
+    PushBack(std::move(cmd));
+    lock.unlock();
+    notifier_.notify_one();
+    return evicted;
+  }
+
   // return front element if queue isn't empty
   // otherwise blocks
   // Note: it ignores sentinel so you can't stop consumer thread
   [[nodiscard]] element Pop() {
     std::unique_lock<std::mutex> lock{mutex_};
-    notifier_.wait(lock, [this]() { return !IsEmpty(); });
-    return PopFront();
+    WaitConsumer(lock, [this]() { return !IsEmpty(); });
+    element value = PopFront();
+    NotifyProducer(lock);
+    return value;
   }
 
   // return front element if queue is not empty
   // return nullopt if queue is empty and doesn't have sentinel (== false)
   // otherwise (queue is empty and has sentinel) block
   [[nodiscard]] std::optional<element> TryPop() {
+    bool blocked = false;
+    return TryPop(blocked);
+  }
+
+  // the same as `TryPop()`, `blocked` tells whether the call had to wait
+  [[nodiscard]] std::optional<element> TryPop(bool& blocked) {
     std::optional<element> result{};
 
     std::unique_lock<std::mutex> lock{mutex_};
-    notifier_.wait(lock, [this]() {
+    blocked = WaitConsumer(lock, [this]() {
       // wait (block) while the <empty> queue has <sentinel>
-      return !IsEmpty() || !halt_;
+      return !IsEmpty() || !halt_ || wakeups_ > 0;
     });
     if (!IsEmpty()) {
       result.emplace(PopFront());
+      NotifyProducer(lock);
+    } else if (wakeups_ > 0) {
+      wakeups_--;
+    }
+    return result;
+  }
+
+  // make a consumer blocked in `TryPop` (or the next one to block) return
+  // nullopt without taking a slot, e.g. to look for work kept elsewhere
+  // Note: there are no more pending calls than blocked consumers (or one
+  // if none is blocked) so unused calls don't pile up
+  void Wake() {
+    {
+      std::lock_guard lock{mutex_};
+      if (wakeups_ >= std::max<std::size_t>(waiting_consumers_, 1)) {
+        return;
+      }
+      wakeups_++;
+    }
+    notifier_.notify_one();
+  }
+
+  // return front element if queue is not empty otherwise nullopt
+  // Note: never blocks, ignores sentinel
+  [[nodiscard]] std::optional<element> Poll() {
+    std::optional<element> result{};
+    std::unique_lock<std::mutex> lock{mutex_};
+    if (!IsEmpty()) {
+      result.emplace(PopFront());
+      NotifyProducer(lock);
     }
-    lock.unlock();
     return result;
   }
 
@@ -72,6 +199,7 @@ class CcQueue {
       halt_ = false;
     }
     notifier_.notify_all();
+    not_full_.notify_all();
   }
 
   void Resume() noexcept {
@@ -80,33 +208,121 @@ class CcQueue {
     // no need to notify as noone wait on it: notifier_.notify_all();
   }
 
+  [[nodiscard]] std::size_t Capacity() const noexcept { return capacity_; }
+
+  // approximate number of elements: doesn't lock so it's cheap to spin on
+  [[nodiscard]] std::size_t Size() const noexcept {
+    return approx_size_.load(std::memory_order_relaxed);
+  }
+
  private:
-  void PushBack(element&& value) noexcept {
+  struct Segment {
+    std::array<element, kSegmentSize> slots{};
+    Segment* next{nullptr};
+  };
+
+  void PushBack(element&& value) {
     assert(!IsFull());
-    container_[back_] = std::move(value);
-    back_ = (back_ + 1) % kCapacity;
+    if (tail_ == nullptr) {
+      head_ = tail_ = AcquireSegment();
+    } else if (back_ == kSegmentSize) {
+      tail_->next = AcquireSegment();
+      tail_ = tail_->next;
+      back_ = 0;
+    }
+    tail_->slots[back_++] = std::move(value);
     size_++;
+    approx_size_.store(size_, std::memory_order_relaxed);
   }
 
   [[nodiscard]] element PopFront() noexcept {
     assert(!IsEmpty());
-    element value = std::move(container_[front_]);
-    front_ = (front_ + 1) % kCapacity;
+    element value = std::move(head_->slots[front_++]);
     size_--;
+    approx_size_.store(size_, std::memory_order_relaxed);
+    if (head_ == tail_) {
+      if (size_ == 0) {
+        // keep the only segment and start it over
+        front_ = back_ = 0;
+      }
+    } else if (front_ == kSegmentSize) {
+      Segment* drained = head_;
+      head_ = head_->next;
+      front_ = 0;
+      RecycleSegment(drained);
+    }
     return value;
   }
 
+  [[nodiscard]] Segment* AcquireSegment() {
+    if (spare_ == nullptr) {
+      return new Segment{};
+    }
+    Segment* segment = spare_;
+    spare_ = spare_->next;
+    segment->next = nullptr;
+    return segment;
+  }
+
+  // Note: slots hold moved-from elements only
+  void RecycleSegment(Segment* segment) noexcept {
+    segment->next = spare_;
+    spare_ = segment;
+  }
+
+  static void Release(Segment* segment) noexcept {
+    while (segment != nullptr) {
+      delete std::exchange(segment, segment->next);
+    }
+  }
+
+  // block on `notifier_` until `predicate` holds
+  // return false if it held already
+  template <class Predicate>
+  bool WaitConsumer(std::unique_lock<std::mutex>& lock, Predicate predicate) {
+    if (predicate()) {
+      return false;
+    }
+    waiting_consumers_++;
+    notifier_.wait(lock, predicate);
+    waiting_consumers_--;
+    return true;
+  }
+
+  // unlock and wake up a producer blocked in `TryPushFor` if any
+  void NotifyProducer(std::unique_lock<std::mutex>& lock) noexcept {
+    const bool has_blocked = blocked_producers_ > 0;
+    lock.unlock();
+    if (has_blocked) {
+      not_full_.notify_one();
+    }
+  }
+
   [[nodiscard]] bool IsEmpty() const noexcept { return size_ == 0; }
 
-  [[nodiscard]] bool IsFull() const noexcept { return size_ == kCapacity; }
+  [[nodiscard]] bool IsFull() const noexcept { return size_ == capacity_; }
 
   static constexpr std::chrono::milliseconds kMaxTimeout{100};
 
   std::mutex mutex_;
   std::condition_variable notifier_;
-  container container_;
+  // consumers blocked on `notifier_`
+  std::size_t waiting_consumers_{0};
+  // `Wake` calls not consumed by `TryPop` yet
+  std::size_t wakeups_{0};
+  // producers blocked in `TryPushFor` wait here
+  std::condition_variable not_full_;
+  std::size_t blocked_producers_{0};
+  const std::size_t capacity_;
+  // elements are in [head_[front_], tail_[back_])
+  Segment* head_{nullptr};
+  Segment* tail_{nullptr};
+  // drained segments ready for reuse
+  Segment* spare_{nullptr};
   std::size_t front_{0};
   std::size_t back_{0};
   std::size_t size_{0};
+  // copy of `size_` readable without the lock
+  std::atomic<std::size_t> approx_size_{0};
   bool halt_;
 };
@@ -0,0 +1,564 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "small_function.hpp"
+#include "task.hpp"
+#include "thread_pool.hpp"
+
+namespace klyaksa {
+
+template <class R>
+class Future;
+
+template <class R>
+class Promise;
+
+namespace detail {
+
+// `void` can't be stored so it's replaced by an empty type
+template <class R>
+using StoredValue = std::conditional_t<std::is_void_v<R>, std::monostate, R>;
+
+/**
+ * State shared by a `Promise` and its `Future`.
+ * It's reference counted by both of them and goes back to the thread's
+ * `StatePool` instead of the heap once nobody refers to it.
+ */
+template <class R>
+class SharedState {
+ public:
+  using Value = StoredValue<R>;
+
+  // return state referenced once
+  static SharedState* Create();
+
+  void AddRef() noexcept { refs_.fetch_add(1, std::memory_order_relaxed); }
+
+  void Release() noexcept;
+
+  template <class... Args>
+  [[nodiscard]] bool TrySetValue(Args&&... args) {
+    std::unique_lock lock{mutex_};
+    if (ready_.load(std::memory_order_relaxed) != 0) {
+      return false;
+    }
+    value_.emplace(std::forward<Args>(args)...);
+    Complete(lock);
+    return true;
+  }
+
+  [[nodiscard]] bool TrySetException(std::exception_ptr error) {
+    std::unique_lock lock{mutex_};
+    if (ready_.load(std::memory_order_relaxed) != 0) {
+      return false;
+    }
+    error_ = std::move(error);
+    Complete(lock);
+    return true;
+  }
+
+  [[nodiscard]] bool IsReady() const noexcept {
+    return ready_.load(std::memory_order_acquire) != 0;
+  }
+
+  void Wait() const noexcept {
+    while (ready_.load(std::memory_order_acquire) == 0) {
+      ready_.wait(0, std::memory_order_acquire);
+    }
+  }
+
+  // Note: the state must be ready
+  [[nodiscard]] Value TakeValue() {
+    assert(IsReady());
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return std::move(*value_);
+  }
+
+  // run `callback` once the state is ready: right away if it's ready
+  void OnReady(SmallFunction&& callback) {
+    std::unique_lock lock{mutex_};
+    if (ready_.load(std::memory_order_relaxed) == 0) {
+      assert(!continuation_ && "only one continuation is supported");
+      continuation_ = std::move(callback);
+      return;
+    }
+    lock.unlock();
+    callback();
+  }
+
+ private:
+  template <class>
+  friend class StatePool;
+
+  // mark the state as ready, wake up waiters and run the continuation
+  void Complete(std::unique_lock<std::mutex>& lock) {
+    ready_.store(1, std::memory_order_release);
+    SmallFunction continuation{std::move(continuation_)};
+    lock.unlock();
+    ready_.notify_all();
+    if (continuation) {
+      continuation();
+    }
+  }
+
+  void Reset() noexcept {
+    value_.reset();
+    error_ = nullptr;
+    continuation_ = SmallFunction{};
+    ready_.store(0, std::memory_order_relaxed);
+  }
+
+  std::mutex mutex_;
+  std::atomic<std::uint32_t> ready_{0};
+  std::atomic<std::uint32_t> refs_{0};
+  std::optional<Value> value_;
+  std::exception_ptr error_;
+  SmallFunction continuation_;
+};
+
+/**
+ * Thread-local cache of released states: a state released by one thread
+ * may be reused by another one, the reference count orders the accesses.
+ */
+template <class R>
+class StatePool {
+ public:
+  // the rest of released states go back to the heap
+  static constexpr std::size_t kMaxCached{1024};
+
+  StatePool() = default;
+  StatePool(const StatePool&) = delete;
+  StatePool& operator=(const StatePool&) = delete;
+
+  ~StatePool() {
+    for (auto* state : cached_) {
+      delete state;
+    }
+  }
+
+  static StatePool& Local() {
+    thread_local StatePool pool;
+    return pool;
+  }
+
+  [[nodiscard]] SharedState<R>* Acquire() {
+    if (cached_.empty()) {
+      return new SharedState<R>{};
+    }
+    auto* state = cached_.back();
+    cached_.pop_back();
+    return state;
+  }
+
+  void Recycle(SharedState<R>* state) noexcept {
+    state->Reset();
+    if (cached_.size() < kMaxCached) {
+      try {
+        cached_.push_back(state);
+        return;
+      } catch (...) {
+        // fallthrough: free it
+      }
+    }
+    delete state;
+  }
+
+ private:
+  std::vector<SharedState<R>*> cached_;
+};
+
+template <class R>
+SharedState<R>* SharedState<R>::Create() {
+  auto* state = StatePool<R>::Local().Acquire();
+  state->refs_.store(1, std::memory_order_relaxed);
+  return state;
+}
+
+template <class R>
+void SharedState<R>::Release() noexcept {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    StatePool<R>::Local().Recycle(this);
+  }
+}
+
+// type produced by the continuation `Func` of `Future<R>`
+template <class Func, class R>
+struct ContinuationResult {
+  using type = std::invoke_result_t<Func, R>;
+};
+
+template <class Func>
+struct ContinuationResult<Func, void> {
+  using type = std::invoke_result_t<Func>;
+};
+
+// set result of `func` or exception it throws to `promise`
+template <class U, class Func>
+void Fulfil(Promise<U>& promise, Func&& func);
+
+}  // namespace detail
+
+/**
+ * Single-owner result of asynchronous operation.
+ *
+ * Unlike `std::future` its shared state is recycled and the result
+ * can be consumed without blocking via `Then`.
+ */
+template <class R>
+class Future {
+ public:
+  Future() noexcept = default;
+
+  Future(const Future&) = delete;
+  Future& operator=(const Future&) = delete;
+
+  Future(Future&& other) noexcept
+      : state_{std::exchange(other.state_, nullptr)} {}
+
+  Future& operator=(Future&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      state_ = std::exchange(other.state_, nullptr);
+    }
+    return *this;
+  }
+
+  ~Future() { Reset(); }
+
+  [[nodiscard]] bool Valid() const noexcept { return state_ != nullptr; }
+
+  [[nodiscard]] bool IsReady() const noexcept {
+    assert(Valid());
+    return state_->IsReady();
+  }
+
+  void Wait() const noexcept {
+    assert(Valid());
+    state_->Wait();
+  }
+
+  /**
+   * Block until the result is ready and return it (or throw the stored
+   * exception). The future becomes invalid.
+   */
+  R Get() {
+    assert(Valid());
+    // adopt the reference so it's released whatever happens
+    Future owner{std::exchange(state_, nullptr)};
+    owner.state_->Wait();
+    if constexpr (std::is_void_v<R>) {
+      (void)owner.state_->TakeValue();
+    } else {
+      return owner.state_->TakeValue();
+    }
+  }
+
+  /**
+   * Invoke `callback` with the ready future on the thread which makes it
+   * ready or right away if it's ready already.
+   * The callback runs inline so it must be short.
+   * The future becomes invalid.
+   */
+  template <class Func>
+    requires std::is_invocable_v<std::decay_t<Func>&, Future<R>&&>
+  void OnReady(Func&& callback) && {
+    assert(Valid());
+    auto* state = state_;
+    state->OnReady([callback = std::forward<Func>(callback),
+                    future = std::move(*this)]() mutable {
+      std::invoke(callback, std::move(future));
+    });
+  }
+
+  /**
+   * Post `fn` to `executor` once the result is ready: `fn` gets the value
+   * (nothing for `Future<void>`), its result goes to the returned future.
+   * If this future holds an exception `fn` isn't called and the exception
+   * is forwarded. If the pool rejects the continuation it's run inline.
+   * The future becomes invalid.
+   */
+  template <class Func,
+            class U = typename detail::ContinuationResult<Func, R>::type>
+  [[nodiscard]] Future<U> Then(ThreadPool& executor, Func&& fn) &&;
+
+ private:
+  friend class Promise<R>;
+
+  // adopt a reference to the `state`
+  explicit Future(detail::SharedState<R>* state) noexcept : state_{state} {}
+
+  void Reset() noexcept {
+    if (state_ != nullptr) {
+      std::exchange(state_, nullptr)->Release();
+    }
+  }
+
+  detail::SharedState<R>* state_{nullptr};
+};
+
+/**
+ * Producer side of `Future`.
+ * Destroying a promise without a result stores `broken_promise` error.
+ */
+template <class R>
+class Promise {
+ public:
+  Promise() : state_{detail::SharedState<R>::Create()} {}
+
+  Promise(const Promise&) = delete;
+  Promise& operator=(const Promise&) = delete;
+
+  Promise(Promise&& other) noexcept
+      : state_{std::exchange(other.state_, nullptr)},
+        retrieved_{other.retrieved_} {}
+
+  Promise& operator=(Promise&& other) noexcept {
+    if (this != &other) {
+      Abandon();
+      state_ = std::exchange(other.state_, nullptr);
+      retrieved_ = other.retrieved_;
+    }
+    return *this;
+  }
+
+  ~Promise() { Abandon(); }
+
+  // @throw std::future_error if the future was retrieved already
+  [[nodiscard]] Future<R> GetFuture() {
+    assert(state_);
+    if (std::exchange(retrieved_, true)) {
+      throw std::future_error(std::future_errc::future_already_retrieved);
+    }
+    state_->AddRef();
+    return Future<R>{state_};
+  }
+
+  // @throw std::future_error if the result was set already
+  template <class... Args>
+    requires std::is_constructible_v<detail::StoredValue<R>, Args...>
+  void SetValue(Args&&... args) {
+    assert(state_);
+    if (!state_->TrySetValue(std::forward<Args>(args)...)) {
+      throw std::future_error(std::future_errc::promise_already_satisfied);
+    }
+  }
+
+  // @throw std::future_error if the result was set already
+  void SetException(std::exception_ptr error) {
+    assert(state_);
+    if (!state_->TrySetException(std::move(error))) {
+      throw std::future_error(std::future_errc::promise_already_satisfied);
+    }
+  }
+
+ private:
+  void Abandon() noexcept {
+    if (state_ == nullptr) {
+      return;
+    }
+    try {
+      (void)state_->TrySetException(std::make_exception_ptr(
+          std::future_error(std::future_errc::broken_promise)));
+    } catch (...) {
+      // continuation failed: nobody to report to
+    }
+    std::exchange(state_, nullptr)->Release();
+  }
+
+  detail::SharedState<R>* state_;
+  bool retrieved_{false};
+};
+
+namespace detail {
+
+template <class U, class Func>
+void Fulfil(Promise<U>& promise, Func&& func) {
+  try {
+    if constexpr (std::is_void_v<U>) {
+      std::invoke(func);
+      promise.SetValue();
+    } else {
+      promise.SetValue(std::invoke(func));
+    }
+  } catch (...) {
+    promise.SetException(std::current_exception());
+  }
+}
+
+}  // namespace detail
+
+template <class R>
+template <class Func, class U>
+Future<U> Future<R>::Then(ThreadPool& executor, Func&& fn) && {
+  Promise<U> promise;
+  auto result = promise.GetFuture();
+  std::move(*this).OnReady([executor = &executor, fn = std::forward<Func>(fn),
+                            promise = std::move(promise)](
+                               Future<R>&& ready) mutable {
+    auto stage = Task::Detached([fn = std::move(fn),
+                                 promise = std::move(promise),
+                                 ready = std::move(ready)]() mutable {
+      detail::Fulfil(promise, [&]() -> U {
+        if constexpr (std::is_void_v<R>) {
+          ready.Get();
+          return std::invoke(fn);
+        } else {
+          return std::invoke(fn, ready.Get());
+        }
+      });
+    });
+    if (!executor->Post(std::move(stage))) {
+      std::invoke(stage);
+    }
+  });
+  return result;
+}
+
+/**
+ * Post function for execution like `Dispatch` does
+ * but hand out its result as `Future`.
+ * @return nullopt if the task was rejected
+ */
+template <traits::Bindable Func, traits::Bindable... Args,
+          class R = std::invoke_result_t<Func, Args...>>
+requires traits::Taskable<Func, Args...>
+[[nodiscard]] std::optional<Future<R>> Async(ThreadPool& executor, Func&& f,
+                                             Args&&... args) {
+  Promise<R> promise;
+  auto future = promise.GetFuture();
+  if (!Dispatch(executor, [promise = std::move(promise),
+                           func = std::forward<Func>(f),
+                           ... params = std::forward<Args>(args)]() mutable {
+        detail::Fulfil(promise, [&]() -> R {
+          return std::invoke(func, std::unwrap_reference_t<Args>(params)...);
+        });
+      })) {
+    return std::nullopt;
+  }
+  return std::make_optional(std::move(future));
+}
+
+// `std::vector<R>` or nothing for `void`
+template <class R>
+using WhenAllResult =
+    std::conditional_t<std::is_void_v<R>, void, std::vector<R>>;
+
+/**
+ * Future which becomes ready when all the `futures` are ready:
+ * it holds their values in the same order or the exception of the first
+ * failed one (in order of completion).
+ */
+template <class R>
+[[nodiscard]] Future<WhenAllResult<R>> WhenAll(
+    std::vector<Future<R>> futures) {
+  using Result = WhenAllResult<R>;
+  struct Join {
+    std::atomic<std::size_t> remaining;
+    std::vector<std::optional<detail::StoredValue<R>>> values;
+    std::mutex mutex;
+    std::exception_ptr error;
+    Promise<Result> promise;
+
+    void Finish() {
+      if (error) {
+        promise.SetException(error);
+      } else if constexpr (std::is_void_v<R>) {
+        promise.SetValue();
+      } else {
+        std::vector<R> result;
+        result.reserve(values.size());
+        for (auto&& value : values) {
+          result.push_back(std::move(*value));
+        }
+        promise.SetValue(std::move(result));
+      }
+    }
+  };
+
+  auto join = std::make_shared<Join>();
+  join->remaining.store(futures.size(), std::memory_order_relaxed);
+  join->values.resize(futures.size());
+  auto result = join->promise.GetFuture();
+  if (futures.empty()) {
+    join->Finish();
+    return result;
+  }
+  for (std::size_t i = 0; i < futures.size(); i++) {
+    std::move(futures[i]).OnReady([join, i](Future<R>&& ready) {
+      try {
+        if constexpr (std::is_void_v<R>) {
+          ready.Get();
+        } else {
+          join->values[i].emplace(ready.Get());
+        }
+      } catch (...) {
+        std::lock_guard lock{join->mutex};
+        if (!join->error) {
+          join->error = std::current_exception();
+        }
+      }
+      if (join->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        join->Finish();
+      }
+    });
+  }
+  return result;
+}
+
+// index of the first ready future and its value if any
+template <class R>
+using WhenAnyResult = std::conditional_t<std::is_void_v<R>, std::size_t,
+                                         std::pair<std::size_t, R>>;
+
+/**
+ * Future which becomes ready as soon as any of the `futures` is ready:
+ * it holds the index and the value (or the exception) of that future.
+ * Results of the others are dropped.
+ * Note: `futures` must not be empty
+ */
+template <class R>
+[[nodiscard]] Future<WhenAnyResult<R>> WhenAny(
+    std::vector<Future<R>> futures) {
+  using Result = WhenAnyResult<R>;
+  struct Race {
+    std::atomic<bool> done{false};
+    Promise<Result> promise;
+  };
+
+  assert(!futures.empty());
+  auto race = std::make_shared<Race>();
+  auto result = race->promise.GetFuture();
+  for (std::size_t i = 0; i < futures.size(); i++) {
+    std::move(futures[i]).OnReady([race, i](Future<R>&& ready) {
+      if (race->done.exchange(true, std::memory_order_acq_rel)) {
+        return;
+      }
+      detail::Fulfil(race->promise, [&]() -> Result {
+        if constexpr (std::is_void_v<R>) {
+          ready.Get();
+          return i;
+        } else {
+          return Result{i, ready.Get()};
+        }
+      });
+    });
+  }
+  return result;
+}
+
+}  // namespace klyaksa
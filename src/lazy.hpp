@@ -0,0 +1,243 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <optional>
+#include <utility>
+#include <variant>
+
+#include "task.hpp"
+#include "thread_pool.hpp"
+
+namespace klyaksa {
+
+template <class T>
+class Lazy;
+
+namespace detail {
+
+// `void` can't be stored so it's replaced by an empty type
+template <class T>
+using LazyValue = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+// resumes whoever awaits the finished coroutine
+struct LazyFinal {
+  bool await_ready() const noexcept { return false; }
+
+  template <class Promise>
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<Promise> handle) noexcept {
+    auto continuation = handle.promise().continuation;
+    return continuation ? continuation : std::noop_coroutine();
+  }
+
+  void await_resume() const noexcept {}
+};
+
+template <class T>
+class LazyPromiseBase {
+ public:
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+
+  LazyFinal final_suspend() const noexcept { return {}; }
+
+  void unhandled_exception() noexcept {
+    result_.template emplace<2>(std::current_exception());
+  }
+
+  LazyValue<T> TakeResult() {
+    if (result_.index() == 2) {
+      std::rethrow_exception(std::get<2>(result_));
+    }
+    return std::move(std::get<1>(result_));
+  }
+
+  std::coroutine_handle<> continuation;
+
+ protected:
+  std::variant<std::monostate, LazyValue<T>, std::exception_ptr> result_;
+};
+
+template <class T>
+class LazyPromise : public LazyPromiseBase<T> {
+ public:
+  Lazy<T> get_return_object() noexcept;
+
+  template <class U>
+  void return_value(U&& value) {
+    this->result_.template emplace<1>(std::forward<U>(value));
+  }
+};
+
+template <>
+class LazyPromise<void> : public LazyPromiseBase<void> {
+ public:
+  Lazy<void> get_return_object() noexcept;
+
+  void return_void() noexcept { result_.emplace<1>(); }
+};
+
+/**
+ * Eager coroutine which destroys itself when it's done,
+ * drives a `Lazy` posted to a pool
+ */
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() noexcept {
+      return {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+
+    // started by the posted task
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+
+    std::suspend_never final_suspend() const noexcept { return {}; }
+
+    void return_void() const noexcept {}
+
+    // the body catches everything
+    void unhandled_exception() const noexcept { std::terminate(); }
+  };
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+// resumes the coroutine once, destroys it if it has never been resumed
+class ResumeOnce {
+ public:
+  explicit ResumeOnce(std::coroutine_handle<> handle) noexcept
+      : handle_{handle} {}
+
+  ResumeOnce(ResumeOnce&& other) noexcept
+      : handle_{std::exchange(other.handle_, nullptr)} {}
+
+  ResumeOnce& operator=(ResumeOnce&&) = delete;
+
+  ~ResumeOnce() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  void operator()() { std::exchange(handle_, nullptr).resume(); }
+
+ private:
+  std::coroutine_handle<> handle_;
+};
+
+template <class T>
+Detached Drive(Lazy<T> lazy, std::promise<T> promise) {
+  try {
+    if constexpr (std::is_void_v<T>) {
+      co_await std::move(lazy);
+      promise.set_value();
+    } else {
+      promise.set_value(co_await std::move(lazy));
+    }
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+  }
+}
+
+}  // namespace detail
+
+/**
+ * Coroutine which starts when it's awaited (or posted with `Post`)
+ * and resumes its awaiter when it's done, without a thread blocked
+ * in between. Combine with `co_await executor.Schedule()` and
+ * `co_await timed_executor.SleepFor(delay)` to hop between threads.
+ */
+template <class T = void>
+class [[nodiscard]] Lazy {
+ public:
+  using promise_type = detail::LazyPromise<T>;
+
+  Lazy(Lazy&& other) noexcept
+      : handle_{std::exchange(other.handle_, nullptr)} {}
+
+  Lazy& operator=(Lazy&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+
+  Lazy(const Lazy&) = delete;
+  Lazy& operator=(const Lazy&) = delete;
+
+  ~Lazy() { Reset(); }
+
+  // start the coroutine (symmetric transfer) and resume the awaiter
+  // with its result or exception once it's done
+  auto operator co_await() && noexcept {
+    struct Awaiter {
+      bool await_ready() const noexcept { return handle.done(); }
+
+      std::coroutine_handle<> await_suspend(
+          std::coroutine_handle<> awaiter) noexcept {
+        handle.promise().continuation = awaiter;
+        return handle;
+      }
+
+      T await_resume() {
+        if constexpr (std::is_void_v<T>) {
+          handle.promise().TakeResult();
+        } else {
+          return handle.promise().TakeResult();
+        }
+      }
+
+      std::coroutine_handle<promise_type> handle;
+    };
+    return Awaiter{handle_};
+  }
+
+ private:
+  friend promise_type;
+
+  explicit Lazy(std::coroutine_handle<promise_type> handle) noexcept
+      : handle_{handle} {}
+
+  void Reset() noexcept {
+    if (handle_) {
+      std::exchange(handle_, nullptr).destroy();
+    }
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template <class T>
+Lazy<T> LazyPromise<T>::get_return_object() noexcept {
+  return Lazy<T>{std::coroutine_handle<LazyPromise>::from_promise(*this)};
+}
+
+inline Lazy<void> LazyPromise<void>::get_return_object() noexcept {
+  return Lazy<void>{std::coroutine_handle<LazyPromise>::from_promise(*this)};
+}
+
+}  // namespace detail
+
+/**
+ * Start the coroutine on a worker of the pool.
+ * If the task is dropped without running (discarded by the overflow policy
+ * or left in a destroyed pool) the coroutine is destroyed and the future
+ * reports `broken_promise`.
+ * @return nullopt if the pool rejected it
+ */
+template <class T>
+[[nodiscard]] std::optional<std::future<T>> Post(ThreadPool& executor,
+                                                 Lazy<T> lazy) {
+  std::promise<T> promise;
+  auto fut = promise.get_future();
+  auto driver = detail::Drive(std::move(lazy), std::move(promise)).handle;
+  if (!executor.Post(Task::Detached(detail::ResumeOnce{driver}))) {
+    return std::nullopt;
+  }
+  return std::make_optional(std::move(fut));
+}
+
+}  // namespace klyaksa
@@ -0,0 +1,376 @@
+// Bounded MPMC queue based on D. Vyukov's algorithm:
+// https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+/**
+ * Lock-free alternative to `CcQueue` with the same contract:
+ * `TryPush` never blocks, `TryPop` blocks while the queue is empty and not
+ * halted.
+ *
+ * Every cell carries a sequence number which tells producers and consumers
+ * whose turn it is to access the cell, so the fast path is a single CAS on
+ * `enqueue_pos_`/`dequeue_pos_`. Consumers park on an atomic counter only when
+ * the queue is empty; producers touch it only when somebody sleeps.
+ * Producers blocked in `TryPushFor` park on a condition variable
+ * which consumers touch only when somebody is blocked.
+ * Cells are allocated once by the constructor: the algorithm needs
+ * a fixed ring, so unlike `CcQueue` it can't be unbounded.
+ */
+template <typename T>
+class LfQueue {
+ public:
+  static_assert(std::is_move_constructible_v<T>);
+  static_assert(std::is_move_assignable_v<T>);
+  static_assert(std::is_default_constructible_v<T>);
+
+  // the same value as `CcQueue::kUnbounded` which is rejected here
+  static constexpr std::size_t kUnbounded{
+      std::numeric_limits<std::size_t>::max()};
+
+  using element = T;
+
+  explicit LfQueue(std::size_t capacity) : halt_{true}, capacity_{capacity} {
+    if (capacity_ == 0 || capacity_ == kUnbounded) {
+      throw std::invalid_argument(
+          "LfQueue capacity must be positive and bounded");
+    }
+    cells_ = std::make_unique<Cell[]>(capacity_);
+    for (std::size_t i = 0; i < capacity_; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // return true if value was pushed successfully (queue is not full)
+  // otherwise return false on failure and doesn't block
+  // Note: `cmd` is left untouched on failure
+  [[nodiscard]] bool TryPush(element&& cmd) {
+    if (!Enqueue(cmd)) {
+      return false;
+    }
+    WakeConsumer();
+    return true;
+  }
+
+  [[nodiscard]] bool TryPush(const element& cmd)
+    requires std::is_copy_constructible_v<element>
+  {
+    element copy{cmd};
+    return TryPush(std::move(copy));
+  }
+
+  // push as many elements from the front of `values` as fit
+  // and wake up at most that many consumers
+  // return number of pushed elements: the rest are left untouched
+  [[nodiscard]] std::size_t TryPushN(std::span<element> values) {
+    std::size_t pushed = 0;
+    while (pushed < values.size() && Enqueue(values[pushed])) {
+      pushed++;
+    }
+    if (pushed > 0) {
+      WakeConsumers(pushed);
+    }
+    return pushed;
+  }
+
+  // return true if value was pushed before timeout expired
+  // otherwise return false: timeout expired or queue was halted while full
+  // Note: `cmd` is left untouched on failure
+  template <class Rep, class Period>
+  [[nodiscard]] bool TryPushFor(
+      element&& cmd, const std::chrono::duration<Rep, Period>& timeout) {
+    if (TryPush(std::move(cmd))) {
+      return true;
+    }
+    // slow path: the queue is full so park until a consumer frees a cell
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock lock{space_mutex_};
+    blocked_producers_.fetch_add(1, std::memory_order_seq_cst);
+    bool is_pushed = false;
+    for (;;) {
+      const auto epoch = space_epoch_;
+      if (Enqueue(cmd)) {
+        is_pushed = true;
+        break;
+      }
+      if (!halt_.load(std::memory_order_seq_cst)) {
+        break;
+      }
+      if (!not_full_.wait_until(lock, deadline, [&]() {
+            return space_epoch_ != epoch ||
+                   !halt_.load(std::memory_order_seq_cst);
+          })) {
+        break;
+      }
+    }
+    blocked_producers_.fetch_sub(1, std::memory_order_relaxed);
+    lock.unlock();
+    if (is_pushed) {
+      WakeConsumer();
+    }
+    return is_pushed;
+  }
+
+  // push value evicting the front element if queue is full
+  // return evicted element if any
+  // Evicts at most one element: a producer which lost the freed slot
+  // to another one waits for the next free slot.
+  std::optional<element> PushEvictOldest(element&& cmd) {
+    std::optional<element> evicted{};
+    while (!Enqueue(cmd)) {
+      if (!evicted) {
+        evicted = Dequeue();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    WakeConsumer();
+    return evicted;
+  }
+
+  // return front element if queue isn't empty
+  // otherwise blocks
+  // Note: it ignores sentinel so you can't stop consumer thread
+  [[nodiscard]] element Pop() {
+    for (;;) {
+      if (auto value = Dequeue(); value) {
+        return std::move(*value);
+      }
+      const auto signal = PrepareWait();
+      if (auto value = Dequeue(); value) {
+        CancelWait();
+        return std::move(*value);
+      }
+      Wait(signal);
+    }
+  }
+
+  // return front element if queue is not empty
+  // return nullopt if queue is empty and doesn't have sentinel (== false)
+  // otherwise (queue is empty and has sentinel) block
+  [[nodiscard]] std::optional<element> TryPop() {
+    bool blocked = false;
+    return TryPop(blocked);
+  }
+
+  // the same as `TryPop()`, `blocked` tells whether the call had to wait
+  [[nodiscard]] std::optional<element> TryPop(bool& blocked) {
+    blocked = false;
+    for (;;) {
+      if (auto value = Dequeue();
+          value || !halt_.load(std::memory_order_acquire) || TakeWakeup()) {
+        return value;
+      }
+      const auto signal = PrepareWait();
+      if (auto value = Dequeue();
+          value || !halt_.load(std::memory_order_seq_cst) || TakeWakeup()) {
+        CancelWait();
+        return value;
+      }
+      blocked = true;
+      Wait(signal);
+    }
+  }
+
+  // make a consumer blocked in `TryPop` (or the next one to block) return
+  // nullopt without taking a slot, e.g. to look for work kept elsewhere
+  // Note: there are no more pending calls than sleeping consumers (or one
+  // if none sleeps) so unused calls don't pile up
+  void Wake() noexcept {
+    // seq_cst pairs with the consumer's `PrepareWait` like a push
+    auto wakeups = wakeups_.load(std::memory_order_seq_cst);
+    while (wakeups < std::max<std::size_t>(sleepers_.load(), 1) &&
+           !wakeups_.compare_exchange_weak(wakeups, wakeups + 1,
+                                           std::memory_order_seq_cst)) {
+    }
+    WakeConsumer();
+  }
+
+  // return front element if queue is not empty otherwise nullopt
+  // Note: never blocks, ignores sentinel
+  [[nodiscard]] std::optional<element> Poll() { return Dequeue(); }
+
+  void Halt() noexcept {
+    halt_.store(false, std::memory_order_seq_cst);
+    signal_.fetch_add(1, std::memory_order_seq_cst);
+    signal_.notify_all();
+    {
+      std::lock_guard lock{space_mutex_};
+      space_epoch_++;
+    }
+    not_full_.notify_all();
+  }
+
+  void Resume() noexcept {
+    halt_.store(true, std::memory_order_seq_cst);
+    // no need to notify as noone wait on it
+  }
+
+  [[nodiscard]] std::size_t Capacity() const noexcept { return capacity_; }
+
+  // approximate number of elements
+  [[nodiscard]] std::size_t Size() const noexcept {
+    const auto dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+    const auto enqueued = enqueue_pos_.load(std::memory_order_relaxed);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<std::size_t> sequence;
+    element value;
+  };
+
+  // Note: `value` is left untouched on failure
+  [[nodiscard]] bool Enqueue(element& value) {
+    Cell* cell = nullptr;
+    auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[pos % capacity_];
+      const auto seq = cell->sequence.load(std::memory_order_seq_cst);
+      const auto diff =
+          static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // the cell is still occupied by the previous lap: full
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    // seq_cst pairs with the consumer's `PrepareWait`: see `WakeConsumer`
+    cell->sequence.store(pos + 1, std::memory_order_seq_cst);
+    return true;
+  }
+
+  [[nodiscard]] std::optional<element> Dequeue() {
+    Cell* cell = nullptr;
+    auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[pos % capacity_];
+      const auto seq = cell->sequence.load(std::memory_order_seq_cst);
+      const auto diff = static_cast<std::intptr_t>(seq) -
+                        static_cast<std::intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // the cell hasn't been written yet: empty
+        return std::nullopt;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    std::optional<element> value{std::move(cell->value)};
+    // seq_cst pairs with the producer's re-check in `TryPushFor`
+    cell->sequence.store(pos + capacity_, std::memory_order_seq_cst);
+    WakeProducer();
+    return value;
+  }
+
+  // Register as a sleeper before the last check of the queue
+  // so a producer either sees us or we see its element.
+  [[nodiscard]] std::uint32_t PrepareWait() noexcept {
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    return signal_.load(std::memory_order_seq_cst);
+  }
+
+  void CancelWait() noexcept {
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // consume a `Wake` call if there is one
+  [[nodiscard]] bool TakeWakeup() noexcept {
+    auto wakeups = wakeups_.load(std::memory_order_seq_cst);
+    while (wakeups > 0) {
+      if (wakeups_.compare_exchange_weak(wakeups, wakeups - 1,
+                                         std::memory_order_seq_cst)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Wait(std::uint32_t signal) noexcept {
+    signal_.wait(signal, std::memory_order_seq_cst);
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Both the cell publication and this load are seq_cst as well as
+  // the sleeper registration and the following re-check of the cell,
+  // so either we see the sleeper or it sees our element.
+  // Note: no standalone fences as TSan doesn't support them
+  void WakeConsumer() noexcept {
+    if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+      signal_.fetch_add(1, std::memory_order_seq_cst);
+      signal_.notify_one();
+    }
+  }
+
+  // the same as `WakeConsumer` for `count` elements
+  void WakeConsumers(std::size_t count) noexcept {
+    const auto sleepers = sleepers_.load(std::memory_order_seq_cst);
+    if (sleepers == 0) {
+      return;
+    }
+    signal_.fetch_add(1, std::memory_order_seq_cst);
+    if (count >= sleepers) {
+      signal_.notify_all();
+    } else {
+      for (std::size_t i = 0; i < count; i++) {
+        signal_.notify_one();
+      }
+    }
+  }
+
+  // a cell was freed: wake up a producer blocked in `TryPushFor` if any
+  void WakeProducer() noexcept {
+    if (blocked_producers_.load(std::memory_order_seq_cst) > 0) {
+      {
+        std::lock_guard lock{space_mutex_};
+        space_epoch_++;
+      }
+      not_full_.notify_one();
+    }
+  }
+
+  static constexpr std::size_t kCacheLine{64};
+
+  // producers and consumers hammer different counters: keep them apart
+  alignas(kCacheLine) std::atomic<std::size_t> enqueue_pos_{0};
+  alignas(kCacheLine) std::atomic<std::size_t> dequeue_pos_{0};
+  alignas(kCacheLine) std::atomic<std::uint32_t> signal_{0};
+  std::atomic<std::size_t> sleepers_{0};
+  // `Wake` calls not consumed by `TryPop` yet
+  std::atomic<std::size_t> wakeups_{0};
+  std::atomic<bool> halt_;
+  // producers blocked in `TryPushFor` (slow path only) wait here
+  alignas(kCacheLine) std::atomic<std::size_t> blocked_producers_{0};
+  std::mutex space_mutex_;
+  std::condition_variable not_full_;
+  std::uint64_t space_epoch_{0};
+  alignas(kCacheLine) const std::size_t capacity_;
+  std::unique_ptr<Cell[]> cells_;
+};
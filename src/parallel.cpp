@@ -0,0 +1,61 @@
+#include "parallel.hpp"
+
+namespace klyaksa {
+
+namespace detail {
+
+ParallelJob::ParallelJob(std::size_t size, std::size_t grain,
+                         std::size_t participants) noexcept
+    : size_{size}, grain_{grain}, participants_{participants} {}
+
+std::pair<std::size_t, std::size_t> ParallelJob::Claim() noexcept {
+  auto begin = next_.load(std::memory_order_relaxed);
+  for (;;) {
+    if (begin >= size_) {
+      return {size_, size_};
+    }
+    const auto left = size_ - begin;
+    const auto count =
+        std::min(left, std::max(grain_, left / (2 * participants_)));
+    if (next_.compare_exchange_weak(begin, begin + count,
+                                    std::memory_order_relaxed)) {
+      return {begin, begin + count};
+    }
+  }
+}
+
+void ParallelJob::Finish(std::size_t count) noexcept {
+  // release: results of the chunk are visible to the waiter
+  if (finished_.fetch_add(count, std::memory_order_acq_rel) + count == size_) {
+    finished_.notify_all();
+  }
+}
+
+void ParallelJob::Fail(std::exception_ptr error) noexcept {
+  {
+    std::lock_guard lock{error_mutex_};
+    if (!error_) {
+      error_ = std::move(error);
+    }
+  }
+  // nobody claims the rest so it's finished here
+  const auto rest = next_.exchange(size_, std::memory_order_relaxed);
+  if (rest < size_) {
+    Finish(size_ - rest);
+  }
+}
+
+void ParallelJob::Wait() {
+  for (auto finished = finished_.load(std::memory_order_acquire);
+       finished < size_; finished = finished_.load(std::memory_order_acquire)) {
+    finished_.wait(finished, std::memory_order_acquire);
+  }
+  std::lock_guard lock{error_mutex_};
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+}  // namespace detail
+
+}  // namespace klyaksa
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "task.hpp"
+#include "thread_pool.hpp"
+
+namespace klyaksa {
+
+namespace detail {
+
+/**
+ * Indices `[0, size)` split into chunks which participants (the calling
+ * thread and helper tasks) claim one by one.
+ * Guided chunking: a claim takes a share of what is left so chunks are
+ * large at first and shrink down to the grain to even out the tail.
+ */
+class ParallelJob {
+ public:
+  ParallelJob(std::size_t size, std::size_t grain,
+              std::size_t participants) noexcept;
+
+  /**
+   * Call `body(begin, end)` for claimed chunks until none is left.
+   * The first exception stops the job: the rest of the range is skipped.
+   */
+  template <class Body>
+  void Run(Body& body) noexcept {
+    for (;;) {
+      const auto [begin, end] = Claim();
+      if (begin == end) {
+        return;
+      }
+      try {
+        body(begin, end);
+      } catch (...) {
+        Fail(std::current_exception());
+      }
+      Finish(end - begin);
+    }
+  }
+
+  // block until every index is finished, rethrow the first exception
+  void Wait();
+
+ private:
+  [[nodiscard]] std::pair<std::size_t, std::size_t> Claim() noexcept;
+  void Finish(std::size_t count) noexcept;
+  void Fail(std::exception_ptr error) noexcept;
+
+  const std::size_t size_;
+  const std::size_t grain_;
+  const std::size_t participants_;
+  std::atomic<std::size_t> next_{0};
+  std::atomic<std::size_t> finished_{0};
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+};
+
+/**
+ * Run `body(begin, end)` over chunks of `[0, size)` on the calling thread
+ * and up to a helper per worker of `executor`.
+ * Helpers are posted by `PostBatch` so a full queue means fewer helpers
+ * (or helpers run, discarded or blocked on by the `OverflowPolicy`)
+ * rather than a failure, the calling thread alone can finish the job.
+ * A helper which starts after the job is done only finds nothing to claim.
+ */
+template <class Body>
+void RunParallel(ThreadPool& executor, std::size_t size, std::size_t grain,
+                 Body body) {
+  if (size == 0) {
+    return;
+  }
+  const auto participants = executor.WorkerCount() + 1;
+  if (grain == 0) {
+    // enough chunks per participant to balance uneven iterations
+    static constexpr std::size_t kChunksPerParticipant{16};
+    grain = std::max<std::size_t>(
+        1, size / (participants * kChunksPerParticipant));
+  }
+  const auto chunks = (size + grain - 1) / grain;
+  const auto helpers = std::min(participants - 1, chunks - 1);
+  auto job = std::make_shared<ParallelJob>(size, grain, helpers + 1);
+  if (helpers > 0) {
+    std::vector<Task> tasks;
+    tasks.reserve(helpers);
+    for (std::size_t i = 0; i < helpers; i++) {
+      tasks.push_back(
+          Task::Detached([job, body]() mutable { job->Run(body); }));
+    }
+    (void)executor.PostBatch(tasks);
+  }
+  job->Run(body);
+  job->Wait();
+}
+
+}  // namespace detail
+
+/**
+ * Call `fn(i)` for every `i` of `[first, last)` in parallel:
+ * the calling thread takes part and returns when every call is done.
+ * @param grain the smallest number of indices handled by a task,
+ * picked by the range size and the pool size when zero
+ * @throw the first exception thrown by `fn`, the rest of calls are skipped
+ */
+template <std::integral I, class Fn>
+requires std::invocable<Fn&, I>
+void ParallelFor(ThreadPool& executor, I first, std::type_identity_t<I> last,
+                 Fn&& fn, std::size_t grain = 0) {
+  if (last <= first) {
+    return;
+  }
+  const auto size = static_cast<std::size_t>(last - first);
+  detail::RunParallel(executor, size, grain,
+                      [first, &fn](std::size_t begin, std::size_t end) {
+                        for (auto i = begin; i < end; i++) {
+                          std::invoke(fn, static_cast<I>(first + i));
+                        }
+                      });
+}
+
+// `fn(element)` for every element of a random access range
+template <std::ranges::random_access_range Range, class Fn>
+requires std::ranges::sized_range<Range> &&
+         std::invocable<Fn&, std::ranges::range_reference_t<Range>>
+void ParallelFor(ThreadPool& executor, Range&& range, Fn&& fn,
+                 std::size_t grain = 0) {
+  auto it = std::ranges::begin(range);
+  detail::RunParallel(executor, std::ranges::size(range), grain,
+                      [it, &fn](std::size_t begin, std::size_t end) {
+                        for (auto i = begin; i < end; i++) {
+                          std::invoke(fn, it[i]);
+                        }
+                      });
+}
+
+/**
+ * `op` over `init` and every element of the range in unspecified order
+ * and grouping (like `std::reduce`): `op` has to be associative
+ * and commutative.
+ */
+template <std::ranges::random_access_range Range, class T, class Op>
+requires std::ranges::sized_range<Range> &&
+         std::invocable<Op&, T, std::ranges::range_reference_t<Range>>
+[[nodiscard]] T ParallelReduce(ThreadPool& executor, Range&& range, T init,
+                               Op op, std::size_t grain = 0) {
+  auto it = std::ranges::begin(range);
+  std::mutex mutex;
+  std::optional<T> total;
+  detail::RunParallel(executor, std::ranges::size(range), grain,
+                      [it, &op, &mutex, &total](std::size_t begin,
+                                                std::size_t end) {
+                        T partial(it[begin]);
+                        for (auto i = begin + 1; i < end; i++) {
+                          partial = std::invoke(op, std::move(partial), it[i]);
+                        }
+                        // chunks are few: merge them as they are done
+                        std::lock_guard lock{mutex};
+                        total = total ? std::invoke(op, std::move(*total),
+                                                    std::move(partial))
+                                      : std::move(partial);
+                      });
+  return total ? std::invoke(op, std::move(init), std::move(*total)) : init;
+}
+
+/**
+ * Write `fn(element)` of every element of the range to `out`
+ * @return the end of the output
+ */
+template <std::ranges::random_access_range Range,
+          std::random_access_iterator Out, class Fn>
+requires std::ranges::sized_range<Range> &&
+         std::invocable<Fn&, std::ranges::range_reference_t<Range>>
+Out ParallelTransform(ThreadPool& executor, Range&& range, Out out, Fn&& fn,
+                      std::size_t grain = 0) {
+  auto it = std::ranges::begin(range);
+  const auto size = std::ranges::size(range);
+  detail::RunParallel(executor, size, grain,
+                      [it, out, &fn](std::size_t begin, std::size_t end) {
+                        for (auto i = begin; i < end; i++) {
+                          out[i] = std::invoke(fn, it[i]);
+                        }
+                      });
+  return out + static_cast<std::iter_difference_t<Out>>(size);
+}
+
+}  // namespace klyaksa
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <stop_token>
+
+namespace klyaksa {
+
+/**
+ * Place where idle workers sleep when work may appear in several sources
+ * (shared queue, local deques) so no single queue can wake them up.
+ *
+ * Usage by a consumer:
+ * ```
+ * auto epoch = parker.PrepareWait();
+ * if (work found) parker.CancelWait(); else parker.Wait(epoch, stop);
+ * ```
+ * A producer calls `WakeOne()` after it published work. Publication must be
+ * either seq_cst or done under a lock the consumer takes while looking for
+ * work: then the producer sees the registered sleeper or the sleeper sees
+ * the work.
+ */
+class Parker {
+ public:
+  [[nodiscard]] std::uint64_t PrepareWait() noexcept {
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_seq_cst);
+  }
+
+  void CancelWait() noexcept {
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Block until somebody wakes us up after `PrepareWait` or stop is requested
+   * @return false if that happened before so the call didn't block
+   */
+  bool Wait(std::uint64_t epoch, const std::stop_token& stop) {
+    std::unique_lock lock{mutex_};
+    auto woken = [&]() {
+      return epoch_.load(std::memory_order_relaxed) != epoch ||
+             stop.stop_requested();
+    };
+    const bool blocked = !woken();
+    waiter_.wait(lock, woken);
+    lock.unlock();
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    return blocked;
+  }
+
+  /**
+   * `Wait` up to `timeout`, `blocked` tells whether the call blocked
+   * @return false if nobody woke us up in time
+   */
+  template <class Rep, class Period>
+  bool WaitFor(std::uint64_t epoch, const std::stop_token& stop,
+               const std::chrono::duration<Rep, Period>& timeout,
+               bool& blocked) {
+    std::unique_lock lock{mutex_};
+    auto woken = [&]() {
+      return epoch_.load(std::memory_order_relaxed) != epoch ||
+             stop.stop_requested();
+    };
+    blocked = !woken();
+    const bool in_time = waiter_.wait_for(lock, timeout, woken);
+    lock.unlock();
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    return in_time;
+  }
+
+  void WakeOne() {
+    if (sleepers_.load(std::memory_order_seq_cst) == 0) {
+      return;
+    }
+    Bump();
+    waiter_.notify_one();
+  }
+
+  // wake up at most `count` sleepers
+  void Wake(std::size_t count) {
+    const auto sleepers = sleepers_.load(std::memory_order_seq_cst);
+    if (sleepers == 0 || count == 0) {
+      return;
+    }
+    Bump();
+    if (count >= sleepers) {
+      waiter_.notify_all();
+    } else {
+      for (std::size_t i = 0; i < count; i++) {
+        waiter_.notify_one();
+      }
+    }
+  }
+
+  void WakeAll() {
+    Bump();
+    waiter_.notify_all();
+  }
+
+  [[nodiscard]] std::size_t Sleepers() const noexcept {
+    return sleepers_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void Bump() {
+    std::lock_guard lock{mutex_};
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+  }
+
+  std::mutex mutex_;
+  std::condition_variable waiter_;
+  std::atomic<std::uint64_t> epoch_{0};
+  std::atomic<std::size_t> sleepers_{0};
+};
+
+}  // namespace klyaksa
@@ -1,102 +1,444 @@
 #include "scheduler.hpp"
 #include "thread_pool.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
 
 namespace klyaksa {
 
-Scheduler::Scheduler(ThreadPool* executor)
+namespace detail {
+
+struct TimerCell {
+  TimerCell(Timepoint when, Task&& cb) : deadline{when}, task{std::move(cb)} {}
+
+  void Release() noexcept {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  // the inbox and the handle
+  std::atomic<std::uint32_t> refs{2};
+  Timepoint deadline;
+  Task task;
+  TimerCell* next{nullptr};
+  // entry in the vault once the cell is drained, guarded by the vault mutex
+  TimerId id{};
+};
+
+struct PeriodicTimer {
+  PeriodicTimer(Scheduler* owner, SmallFunction callable, Timeout interval,
+                PeriodicMode periodic_mode)
+      : scheduler{owner},
+        fn{std::move(callable)},
+        period{interval},
+        mode{periodic_mode} {}
+
+  Scheduler* const scheduler;
+  SmallFunction fn;
+  const Timeout period;
+  const PeriodicMode mode;
+  // set under the vault mutex, checked by runs without it
+  std::atomic<bool> cancelled{false};
+  // the pending run, guarded by the vault mutex
+  Timepoint deadline{};
+  TimerId id{};
+};
+
+}  // namespace detail
+
+Scheduler::Scheduler(ThreadPool* executor, SchedulerOptions options)
     : executor_{executor},
+      spin_threshold_{options.spin_threshold},
+      late_policy_{options.late_policy},
+      max_lateness_{options.max_lateness},
+      vault_{MakeTimerQueue(options.backend, options.tick)},
       timer_{}  // default constructible
 {}
 
-void Scheduler::ScheduleAt(Timepoint tp, Task&& cb) {
-  if (tp <= Now()) {
-    SubmitToExecutor(std::move(cb));
-    return;
+Scheduler::~Scheduler() {
+  Stop();
+  std::unique_lock lock{vault_mutex_};
+  DrainInbox();
+}
+
+TimerHandle::TimerHandle(const TimerHandle& other) noexcept
+    : scheduler_{other.scheduler_}, cell_{other.cell_} {
+  if (cell_ != nullptr) {
+    cell_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+TimerHandle::TimerHandle(TimerHandle&& other) noexcept
+    : scheduler_{std::exchange(other.scheduler_, nullptr)},
+      cell_{std::exchange(other.cell_, nullptr)} {}
+
+TimerHandle& TimerHandle::operator=(const TimerHandle& other) noexcept {
+  if (this != &other) {
+    *this = TimerHandle{other};
+  }
+  return *this;
+}
+
+TimerHandle& TimerHandle::operator=(TimerHandle&& other) noexcept {
+  if (this != &other) {
+    if (cell_ != nullptr) {
+      cell_->Release();
+    }
+    scheduler_ = std::exchange(other.scheduler_, nullptr);
+    cell_ = std::exchange(other.cell_, nullptr);
+  }
+  return *this;
+}
+
+TimerHandle::~TimerHandle() {
+  if (cell_ != nullptr) {
+    cell_->Release();
+  }
+}
+
+bool TimerHandle::Cancel() {
+  return cell_ != nullptr && scheduler_->Cancel(*cell_);
+}
+
+bool TimerHandle::Reschedule(Timepoint tp, std::chrono::nanoseconds slack) {
+  return cell_ != nullptr &&
+         scheduler_->Reschedule(*cell_, CoalesceDeadline(tp, slack));
+}
+
+bool PeriodicHandle::Cancel() {
+  return timer_ != nullptr && timer_->scheduler->Cancel(*timer_);
+}
+
+TimerHandle Scheduler::ScheduleAt(Timepoint tp, Task&& cb,
+                                  std::chrono::nanoseconds slack) {
+  if (tp > Now()) {
+    tp = CoalesceDeadline(tp, slack);
+  } else if (SubmitToExecutor(std::move(cb))) {
+    return {};
+  }
+  // a rejected task goes to the timer thread which stages it
+  // like any expired timer the executor has no room for
+  auto* cell = new detail::TimerCell{tp, std::move(cb)};
+  cell->next = inbox_.load(std::memory_order_relaxed);
+  while (!inbox_.compare_exchange_weak(cell->next, cell)) {
   }
+  WakeForInbox(tp);
+  return {this, cell};
+}
+
+PeriodicHandle Scheduler::ScheduleEvery(Timeout period, SmallFunction fn,
+                                        PeriodicMode mode) {
+  if (period <= Timeout::zero()) {
+    throw std::invalid_argument("period must be positive");
+  }
+  auto timer = std::make_shared<detail::PeriodicTimer>(this, std::move(fn),
+                                                       period, mode);
   std::unique_lock lock{vault_mutex_};
-  vault_.emplace(tp, std::move(cb));
-  lock.unlock();
-  vault_waiter_.notify_one();
+  Arm(timer, Now() + period);
+  WakeIfEarlier(timer->deadline, lock);
+  return PeriodicHandle{std::move(timer)};
 }
 
 std::size_t Scheduler::CallbackCount() const noexcept {
   std::unique_lock lock{vault_mutex_};
-  return vault_.size();
+  std::size_t count = vault_->Size();
+  // nodes below the head don't change while the consumer's mutex is held
+  for (auto* cell = inbox_.load(); cell != nullptr; cell = cell->next) {
+    count++;
+  }
+  return count;
+}
+
+SchedulerStats Scheduler::Stats() const {
+  std::unique_lock lock{vault_mutex_};
+  return {staged_count_, dropped_count_, staged_.size()};
+}
+
+TimerHandle Scheduler::ScheduleAfter(Timeout delay, Task&& cb,
+                                     std::chrono::nanoseconds slack) {
+  return ScheduleAt(Now() + delay, std::move(cb), slack);
+}
+
+bool Scheduler::Cancel(detail::TimerCell& cell) {
+  std::unique_lock lock{vault_mutex_};
+  DrainInbox();
+  auto task = vault_->Cancel(cell.id);
+  lock.unlock();
+  // the task is destroyed out of the lock: its captures may use the scheduler
+  return task.has_value();
+}
+
+bool Scheduler::Cancel(detail::PeriodicTimer& timer) {
+  std::unique_lock lock{vault_mutex_};
+  if (timer.cancelled.exchange(true, std::memory_order_acq_rel)) {
+    return false;
+  }
+  auto task = vault_->Cancel(timer.id);
+  lock.unlock();
+  return true;
+}
+
+void Scheduler::Arm(const std::shared_ptr<detail::PeriodicTimer>& timer,
+                    Timepoint deadline) {
+  timer->deadline = deadline;
+  // a shared pointer fits into `SmallFunction`: no allocation per run
+  timer->id = vault_->Insert(
+      deadline, Task::Detached([this, timer]() { RunPeriodic(timer); }));
+}
+
+void Scheduler::RunPeriodic(
+    const std::shared_ptr<detail::PeriodicTimer>& timer) {
+  if (timer->cancelled.load(std::memory_order_acquire)) {
+    return;
+  }
+  try {
+    timer->fn();
+  } catch (...) {
+    // the next run is scheduled anyway
+  }
+  const auto now = Now();
+  auto next = timer->deadline + timer->period;
+  switch (timer->mode) {
+    case PeriodicMode::kFixedRate:
+      break;
+    case PeriodicMode::kFixedRateSkip:
+      if (next <= now) {
+        next += timer->period * ((now - next) / timer->period + 1);
+      }
+      break;
+    case PeriodicMode::kFixedDelay:
+      next = now + timer->period;
+      break;
+  }
+  std::unique_lock lock{vault_mutex_};
+  if (timer->cancelled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  Arm(timer, next);
+  WakeIfEarlier(next, lock);
 }
 
-void Scheduler::ScheduleAfter(Timeout delay, Task&& cb) {
-  ScheduleAt(Now() + delay, std::move(cb));
+bool Scheduler::Reschedule(detail::TimerCell& cell, Timepoint tp) {
+  std::unique_lock lock{vault_mutex_};
+  DrainInbox();
+  if (!vault_->Reschedule(cell.id, tp)) {
+    return false;
+  }
+  WakeIfEarlier(tp, lock);
+  return true;
 }
 
 void Scheduler::Stop() {
   if (timer_.joinable()) {
-    if (timer_.request_stop()) {
-      vault_waiter_.notify_one();
-    }
+    // the waits of the timer thread are interrupted by the stop token
+    timer_.request_stop();
     timer_.join();
+    executor_->RemoveSpaceListener(space_listener_);
   }
   // otherwise assumed that it was default constructible
 }
 
 void Scheduler::Start() {
   assert(!timer_.joinable());
+  assert(executor_);
+  {
+    // flush what was staged before the restart
+    std::lock_guard lock{vault_mutex_};
+    space_available_ = true;
+  }
+  space_listener_ = executor_->AddSpaceListener([this]() {
+    {
+      std::lock_guard lock{vault_mutex_};
+      space_available_ = true;
+    }
+    vault_waiter_.notify_one();
+  });
   timer_ = std::jthread{[this](std::stop_token token) { TimerWorker(token); }};
 }
 
 void Scheduler::TimerWorker(std::stop_token stop_token) {
-  static constexpr Timeout kSleepTimeout{100};
-  auto need_wakeup = [this, stop_token]() noexcept {
-    return !vault_.empty() || stop_token.stop_requested();
+  auto earlier = [this]() {
+    if (space_available_ || inbox_.load() != nullptr) {
+      return true;
+    }
+    const auto next = vault_->NextDeadline();
+    return next && *next < sleeping_until_.load(std::memory_order_relaxed);
   };
+  std::unique_lock lock{vault_mutex_};
   while (!stop_token.stop_requested()) {
+    DrainInbox();
     const auto now = Now();
-    std::unique_lock lock{vault_mutex_};
-    if (!vault_.empty()) {  // need to wait for the next scheduled callback
-      auto next_wakeup = vault_.cbegin()->first;
-      if (next_wakeup <= now) {
-        // avoid possible signal + timeout report on cv
-        SubmitExpiredBefore(now);
-        continue;
-      }
-      next_wakeup = std::min(next_wakeup, now + kSleepTimeout);
-      bool wakeup_result =
-          vault_waiter_.wait_until(lock, next_wakeup, need_wakeup);
-      if (wakeup_result && !stop_token.stop_requested()) {
-        assert(!vault_.empty() &&
-               "Cannot be empty otherwise "
-               "it meens CV woke up due to stop request. See predicate.");
-        // cv predecate return true; don't submit if stopped
-        SubmitExpiredBefore(Now());
-      }
-      // otherwise still need to sleep
-    } else {  // no callback scheduled so wait
-      (void)vault_waiter_.wait_for(lock, kSleepTimeout, need_wakeup);
-      // just wake up due to either timeout either stop predicate
+    if (space_available_) {
+      space_available_ = false;
+      FlushStaged(now, lock);
+      DestroyDropped(lock);
+    }
+    const auto next = vault_->NextDeadline();
+    if (next && *next <= now) {
+      SubmitExpiredBefore(now, lock);
+      DestroyDropped(lock);
+      continue;
     }
+    if (next && *next - now <= spin_threshold_) {
+      lock.unlock();
+      SpinUntil(*next, stop_token);
+      lock.lock();
+      continue;
+    }
+    // pairs with the push and the load in `WakeForInbox`: either the timer
+    // thread sees a new cell in `earlier` or the producer sees the deadline
+    sleeping_until_.store(next.value_or(Timepoint::max()));
+    if (next) {
+      (void)vault_waiter_.wait_until(lock, stop_token,
+                                     *next - spin_threshold_, earlier);
+    } else {
+      (void)vault_waiter_.wait(lock, stop_token, earlier);
+    }
+    sleeping_until_.store(Timepoint::min(), std::memory_order_relaxed);
   }
-};
+  DrainInbox();
+  // the waits end without checking the time: don't lose what's due already
+  SubmitExpiredBefore(Now(), lock);
+  DestroyDropped(lock);
+}
+
+void Scheduler::DestroyDropped(std::unique_lock<std::mutex>& lock) {
+  if (dropped_.empty()) {
+    return;
+  }
+  auto dropped = std::exchange(dropped_, {});
+  lock.unlock();
+  dropped.clear();
+  lock.lock();
+}
+
+void Scheduler::SpinUntil(Timepoint deadline,
+                          const std::stop_token& stop_token) const {
+  while (Now() < deadline && !stop_token.stop_requested()) {
+    std::this_thread::yield();
+  }
+}
+
+void Scheduler::WakeIfEarlier(Timepoint tp,
+                              std::unique_lock<std::mutex>& lock) {
+  const bool earlier = tp < sleeping_until_.load(std::memory_order_relaxed);
+  lock.unlock();
+  if (earlier) {
+    vault_waiter_.notify_one();
+  }
+}
 
-void Scheduler::SubmitExpiredBefore(Timepoint tp) {
+void Scheduler::WakeForInbox(Timepoint tp) {
+  if (tp >= sleeping_until_.load()) {
+    return;
+  }
+  // the timer thread is either before its predicate check (and sees
+  // the cell) or waiting: the notification can't get lost in between
+  { std::lock_guard lock{vault_mutex_}; }
+  vault_waiter_.notify_one();
+}
+
+void Scheduler::DrainInbox() {
+  auto* cell = inbox_.exchange(nullptr);
+  // the stack is in reverse order: restore FIFO for equal deadlines
+  detail::TimerCell* fifo = nullptr;
+  while (cell != nullptr) {
+    auto* next = std::exchange(cell->next, fifo);
+    fifo = std::exchange(cell, next);
+  }
+  while (fifo != nullptr) {
+    auto* next = fifo->next;
+    fifo->id = vault_->Insert(fifo->deadline, std::move(fifo->task));
+    fifo->Release();
+    fifo = next;
+  }
+}
+
+void Scheduler::SubmitExpiredBefore(Timepoint tp,
+                                    std::unique_lock<std::mutex>& lock) {
+  assert(executor_);
   // time to execute callbacks
-  auto right = vault_.upper_bound(tp);
-  auto left = vault_.begin();
-  try {
-    while (left != right) {
-      if (!SubmitToExecutor(std::move(left->second))) {
-        // TODO: handle this cases:
-        // - [ ] queue is full
-        // - [ ] excecutor is stopped
-        break;
-      }
-      left++;
+  expired_.clear();
+  vault_->PopExpired(tp, expired_);
+  if (expired_.empty()) {
+    return;
+  }
+  // all of them go through staging to keep the deadline order
+  const auto old = static_cast<std::ptrdiff_t>(staged_.size());
+  for (auto&& timer : expired_) {
+    staged_.push_back({timer.deadline, std::move(timer.task)});
+  }
+  std::inplace_merge(staged_.begin(), staged_.begin() + old, staged_.end(),
+                     [](const StagedTimer& lhs, const StagedTimer& rhs) {
+                       return lhs.deadline < rhs.deadline;
+                     });
+  FlushStaged(tp, lock);
+  for (auto&& timer : staged_) {
+    if (!timer.counted) {
+      timer.counted = true;
+      staged_count_++;
     }
+  }
+}
+
+void Scheduler::FlushStaged(Timepoint now,
+                            std::unique_lock<std::mutex>& lock) {
+  if (late_policy_ == LatePolicy::kDropLate) {
+    while (!staged_.empty() && staged_.front().deadline + max_lateness_ < now) {
+      dropped_.push_back(std::move(staged_.front().task));
+      staged_.pop_front();
+      dropped_count_++;
+    }
+  }
+  if (staged_.empty()) {
+    return;
+  }
+  if (executor_->IsStopped()) {
+    // kept until the executor starts: its `Start` calls the listener
+    // and the late ones are dropped then; ask before the last look
+    executor_->WantSpace();
+    if (executor_->IsStopped()) {
+      return;
+    }
+  }
+  if (PostStaged(lock)) {
+    return;
+  }
+  // ask for a signal before the last attempt: if the queue gets a free slot
+  // after it a worker calls the listener
+  executor_->WantSpace();
+  (void)PostStaged(lock);
+}
+
+bool Scheduler::PostStaged(std::unique_lock<std::mutex>& lock) {
+  batch_.clear();
+  for (auto&& timer : staged_) {
+    batch_.push_back(std::move(timer.task));
+  }
+  std::size_t accepted = 0;
+  lock.unlock();
+  try {
+    accepted = executor_->PostBatch(batch_);
   } catch (...) {
     // handle possible exception
   }
-  // remove only submitted callbacks
-  (void)vault_.erase(vault_.begin(), left);
+  // tasks run by the policy are destroyed out of the lock as well
+  batch_.erase(batch_.begin(),
+               batch_.begin() + static_cast<std::ptrdiff_t>(accepted));
+  lock.lock();
+  // put back what wasn't submitted
+  for (std::size_t i = 0; i < batch_.size(); i++) {
+    staged_[accepted + i].task = std::move(batch_[i]);
+  }
+  batch_.clear();
+  staged_.erase(staged_.begin(),
+                staged_.begin() + static_cast<std::ptrdiff_t>(accepted));
+  return staged_.empty();
 }
 
 bool Scheduler::SubmitToExecutor(Task&& cb) {
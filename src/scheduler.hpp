@@ -6,32 +6,178 @@
 #include <thread>
 
 #include <chrono>
+#include <cstdint>
+#include <deque>
 #include <functional>
-#include <map>
+#include <memory>
+#include <vector>
 
+#include "small_function.hpp"
 #include "task.hpp"
+#include "timer_queue.hpp"
 
 namespace klyaksa {
 
 class ThreadPool;
+class Scheduler;
 
-using Timeout = std::chrono::milliseconds;
-using Timepoint = std::chrono::steady_clock::time_point;
+namespace detail {
+struct TimerCell;
+struct PeriodicTimer;
+}  // namespace detail
+
+/**
+ * Lightweight reference to a scheduled timer: a pointer to a reference
+ * counted cell the timer thread resolves to the entry of the timer queue.
+ * A default constructed handle refers to nothing.
+ * Must not outlive the scheduler which issued it.
+ */
+class TimerHandle {
+ public:
+  TimerHandle() = default;
+
+  TimerHandle(const TimerHandle& other) noexcept;
+  TimerHandle(TimerHandle&& other) noexcept;
+  TimerHandle& operator=(const TimerHandle& other) noexcept;
+  TimerHandle& operator=(TimerHandle&& other) noexcept;
+  ~TimerHandle();
+
+  /**
+   * Remove the timer and destroy its task right away
+   * (the future of the task reports `broken_promise`).
+   * @return false if the task has already been submitted to the executor
+   * or the timer is cancelled. An expired timer staged while the executor
+   * is full counts as submitted: it can't be cancelled.
+   */
+  bool Cancel();
+
+  /**
+   * Move the deadline of the pending timer without a new allocation
+   * @param slack see `Scheduler::ScheduleAt`
+   * @return false if the task has already been submitted (or staged)
+   * to the executor or the timer is cancelled
+   */
+  bool Reschedule(Timepoint tp, std::chrono::nanoseconds slack = {});
+
+ private:
+  friend class Scheduler;
+
+  // takes over a reference to `cell`
+  TimerHandle(Scheduler* scheduler, detail::TimerCell* cell) noexcept
+      : scheduler_{scheduler}, cell_{cell} {}
+
+  Scheduler* scheduler_{nullptr};
+  detail::TimerCell* cell_{nullptr};
+};
+
+enum class PeriodicMode {
+  // runs are due at `start + k * period`, missed ones run back to back
+  kFixedRate,
+  // runs are due at `start + k * period`, missed ones are skipped
+  kFixedRateSkip,
+  // the next run is due `period` after the previous one has finished
+  kFixedDelay,
+};
+
+/**
+ * Owner-independent reference to a periodic timer: the timer keeps running
+ * when all handles are gone. Must not outlive the scheduler which issued it.
+ */
+class PeriodicHandle {
+ public:
+  PeriodicHandle() = default;
+
+  /**
+   * Stop the timer: its pending run is removed, a run in progress
+   * finishes but isn't rescheduled.
+   * @return false if the timer is cancelled already
+   */
+  bool Cancel();
+
+ private:
+  friend class Scheduler;
+
+  explicit PeriodicHandle(
+      std::shared_ptr<detail::PeriodicTimer> timer) noexcept
+      : timer_{std::move(timer)} {}
+
+  std::shared_ptr<detail::PeriodicTimer> timer_;
+};
+
+// fate of expired tasks waiting for free capacity of the executor
+enum class LatePolicy {
+  // wait however late they are
+  kKeep,
+  // destroy tasks later than `SchedulerOptions::max_lateness`
+  // (their futures report `broken_promise`)
+  kDropLate,
+};
+
+struct SchedulerStats {
+  // expired tasks which found the executor full (or stopped) and were staged
+  std::uint64_t staged{0};
+  // staged tasks dropped by `LatePolicy::kDropLate`
+  std::uint64_t dropped{0};
+  // tasks waiting in staging now
+  std::size_t staging_size{0};
+};
+
+struct SchedulerOptions {
+  TimerBackend backend{TimerBackend::kMap};
+  // resolution of `TimerBackend::kWheel`
+  std::chrono::nanoseconds tick{std::chrono::milliseconds{1}};
+  /**
+   * Precision mode: the timer thread stops sleeping this long before
+   * the next deadline and spins (yielding) until it comes, so timers don't
+   * fire late by the wake-up latency of the OS. Zero turns spinning off.
+   */
+  std::chrono::nanoseconds spin_threshold{0};
+  LatePolicy late_policy{LatePolicy::kKeep};
+  std::chrono::nanoseconds max_lateness{std::chrono::milliseconds{100}};
+};
 
 class Scheduler {
  public:
-  Scheduler(ThreadPool* executor);
+  Scheduler(ThreadPool* executor, SchedulerOptions options = {});
 
-  void ScheduleAt(Timepoint tp, Task&& cb);
+  ~Scheduler();
 
-  void ScheduleAfter(Timeout delay, Task&& cb);
+  /**
+   * Lock-free: the timer goes to an inbox drained by the timer thread
+   * which is woken up only if `tp` is earlier than its wake-up time.
+   * @param slack how late the timer may fire: timers with overlapping
+   * windows are moved to the same time (see `CoalesceDeadline`)
+   * so they are handled by one wake-up and posted as one batch
+   * @return handle of the timer, empty if `tp` has already come
+   * and the executor accepts the task immediately; if it rejects it
+   * (or is stopped) the task is staged by the timer thread
+   * Note: expired timers are posted by `PostBatch` which applies
+   * the executor's `OverflowPolicy` on the timer thread (`kCallerRuns`
+   * runs them there), those it rejects are staged until the executor
+   * has room (see `LatePolicy`). Timers expiring while the executor
+   * is stopped are staged until it starts.
+   */
+  TimerHandle ScheduleAt(Timepoint tp, Task&& cb,
+                         std::chrono::nanoseconds slack = {});
+
+  TimerHandle ScheduleAfter(Timeout delay, Task&& cb,
+                            std::chrono::nanoseconds slack = {});
+
+  /**
+   * Run `fn` every `period` starting `period` from now. The callable is
+   * stored once and reused by every run, runs never overlap.
+   * Exceptions thrown by `fn` are swallowed, the timer keeps going.
+   */
+  PeriodicHandle ScheduleEvery(Timeout period, SmallFunction fn,
+                               PeriodicMode mode = PeriodicMode::kFixedRate);
 
   std::size_t CallbackCount() const noexcept;
 
+  [[nodiscard]] SchedulerStats Stats() const;
+
   /**
    * Stop scheduler (background thread-worker).
-   * Before stopping it may submit some expired tasks for execution
-   * or be in the middle of submitting.
+   * Before stopping it submits the tasks which have already expired.
    *
    * Blocks execution thread waiting for thread to join.
    * UB if called concurrently
@@ -48,32 +194,108 @@ class Scheduler {
   bool IsStopped() const noexcept { return !timer_.joinable(); }
 
  private:
+  friend class TimerHandle;
+
+  bool Cancel(detail::TimerCell& cell);
+
+  bool Reschedule(detail::TimerCell& cell, Timepoint tp);
+
+  // move new timers from `inbox_` to `vault_`, `vault_mutex_` must be held
+  void DrainInbox();
+
+  friend class PeriodicHandle;
+
+  bool Cancel(detail::PeriodicTimer& timer);
+
+  // insert the next run of the timer, `vault_mutex_` must be held
+  void Arm(const std::shared_ptr<detail::PeriodicTimer>& timer,
+           Timepoint deadline);
+
+  // a run of the timer posted to the executor
+  void RunPeriodic(const std::shared_ptr<detail::PeriodicTimer>& timer);
+
   /**
-   * Background worker: track time for callbacks
+   * Background worker: sleeps exactly until the next deadline,
+   * a new earlier deadline or stop
    **/
   void TimerWorker(std::stop_token stop_token);
 
+  // the last stretch of precision mode
+  void SpinUntil(Timepoint deadline, const std::stop_token& stop_token) const;
+
+  // notify the timer thread if it sleeps past `tp` and unlock `lock`
+  void WakeIfEarlier(Timepoint tp, std::unique_lock<std::mutex>& lock);
+
+  // notify the timer thread about a timer pushed to `inbox_` if needed
+  void WakeForInbox(Timepoint tp);
+
   /**
-   * Submit all callbacks for execution
+   * Submit all callbacks for execution by a single `PostBatch`,
+   * those which the executor has no room for are staged
    *
    * @param tp expiration date - everything before this time point will be
    *send to executor and removed
-   * @note thread-safe
+   * @param lock of `vault_mutex_`, released while tasks are posted
    **/
-  void SubmitExpiredBefore(Timepoint tp);
+  void SubmitExpiredBefore(Timepoint tp, std::unique_lock<std::mutex>& lock);
+
+  /**
+   * Post staged tasks in deadline order dropping late ones if asked to.
+   * If some are left the executor is asked to signal free capacity.
+   */
+  void FlushStaged(Timepoint now, std::unique_lock<std::mutex>& lock);
+
+  /**
+   * `lock` is released during `PostBatch`: the overflow policy may block,
+   * run or destroy tasks which use the scheduler
+   * @return true if all staged tasks are accepted
+   */
+  bool PostStaged(std::unique_lock<std::mutex>& lock);
+
+  // destroy the tasks of `dropped_` with `lock` released
+  void DestroyDropped(std::unique_lock<std::mutex>& lock);
 
   bool SubmitToExecutor(Task&& cb);
 
   Timepoint Now() const noexcept { return std::chrono::steady_clock::now(); }
 
  private:
+  // expired task which didn't fit the executor's queue
+  struct StagedTimer {
+    Timepoint deadline;
+    Task task;
+    // counted in `SchedulerStats::staged`
+    bool counted{false};
+  };
+
   ThreadPool* executor_;
+  const std::chrono::nanoseconds spin_threshold_;
+  const LatePolicy late_policy_;
+  const std::chrono::nanoseconds max_lateness_;
 
   mutable std::mutex vault_mutex_;
-  // TODO: switch to `std::condition_variable_any` which can use
-  // `std::stop_token`
-  std::condition_variable vault_waiter_;
-  std::multimap<Timepoint, Task> vault_;
+  std::condition_variable_any vault_waiter_;
+  std::unique_ptr<TimerQueue> vault_;
+  // new timers: lock-free stack, its only consumer holds `vault_mutex_`
+  std::atomic<detail::TimerCell*> inbox_{nullptr};
+  // the deadline the timer thread sleeps for, `Timepoint::min()` when it's
+  // awake: only an earlier deadline needs a notification
+  std::atomic<Timepoint> sleeping_until_{Timepoint::min()};
+  // expired timers are moved here and their tasks are posted at once
+  std::vector<ExpiredTimer> expired_;
+  std::vector<Task> batch_;
+  // ordered by deadline, guarded by `vault_mutex_` like the rest
+  // but changed only by the timer thread
+  std::deque<StagedTimer> staged_;
+  // staged tasks dropped by `LatePolicy`: destroyed out of the lock
+  // as their captures may use the scheduler
+  std::vector<Task> dropped_;
+  // set by the executor's space listener (and by its `Start`)
+  bool space_available_{false};
+  // see `ThreadPool::AddSpaceListener`
+  std::uint64_t space_listener_{0};
+  std::uint64_t staged_count_{0};
+  std::uint64_t dropped_count_{0};
   std::jthread timer_;
 };
 
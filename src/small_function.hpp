@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace klyaksa {
+
+/**
+ * Move-only wrapper of `void()` callables.
+ *
+ * libstdc++'s `std::move_only_function` keeps only a couple of pointers
+ * inline, so most lambdas end up on the heap. Here nothrow movable callables
+ * up to `kBufferSize` bytes are stored in the object itself and only larger
+ * ones are allocated.
+ */
+class SmallFunction {
+ public:
+  static constexpr std::size_t kBufferSize{48};
+
+  SmallFunction() noexcept = default;
+
+  template <class Func>
+    requires(!std::is_same_v<std::decay_t<Func>, SmallFunction> &&
+             std::is_invocable_v<std::decay_t<Func>&>)
+  SmallFunction(Func&& f) {
+    using Stored = std::decay_t<Func>;
+    if constexpr (kIsInplace<Stored>) {
+      ::new (static_cast<void*>(buffer_)) Stored(std::forward<Func>(f));
+    } else {
+      ::new (static_cast<void*>(buffer_))
+          Stored*(new Stored(std::forward<Func>(f)));
+    }
+    ops_ = &Model<Stored>::kOps;
+  }
+
+  SmallFunction(const SmallFunction&) = delete;
+  SmallFunction& operator=(const SmallFunction&) = delete;
+
+  SmallFunction(SmallFunction&& other) noexcept { MoveFrom(other); }
+
+  SmallFunction& operator=(SmallFunction&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      MoveFrom(other);
+    }
+    return *this;
+  }
+
+  ~SmallFunction() { Reset(); }
+
+  void operator()() {
+    assert(ops_ != nullptr);
+    ops_->invoke(buffer_);
+  }
+
+  explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+  // true if callables of type `Func` are stored without allocation
+  template <class Func>
+  static constexpr bool IsInplace() noexcept {
+    return kIsInplace<std::decay_t<Func>>;
+  }
+
+ private:
+  struct Ops {
+    void (*invoke)(void* storage);
+    // move the callable to `to` and destroy what's left in `from`
+    void (*relocate)(void* from, void* to) noexcept;
+    void (*destroy)(void* storage) noexcept;
+  };
+
+  template <class Stored>
+  static constexpr bool kIsInplace =
+      sizeof(Stored) <= kBufferSize &&
+      alignof(Stored) <= alignof(std::max_align_t) &&
+      std::is_nothrow_move_constructible_v<Stored>;
+
+  template <class Stored>
+  struct Model {
+    static Stored* Target(void* storage) noexcept {
+      if constexpr (kIsInplace<Stored>) {
+        return std::launder(static_cast<Stored*>(storage));
+      } else {
+        return *std::launder(static_cast<Stored**>(storage));
+      }
+    }
+
+    static void Invoke(void* storage) { std::invoke(*Target(storage)); }
+
+    static void Relocate(void* from, void* to) noexcept {
+      if constexpr (kIsInplace<Stored>) {
+        Stored* source = Target(from);
+        ::new (to) Stored(std::move(*source));
+        source->~Stored();
+      } else {
+        ::new (to) Stored*(Target(from));
+      }
+    }
+
+    static void Destroy(void* storage) noexcept {
+      if constexpr (kIsInplace<Stored>) {
+        Target(storage)->~Stored();
+      } else {
+        delete Target(storage);
+      }
+    }
+
+    static constexpr Ops kOps{&Invoke, &Relocate, &Destroy};
+  };
+
+  void MoveFrom(SmallFunction& other) noexcept {
+    if (other.ops_ != nullptr) {
+      other.ops_->relocate(other.buffer_, buffer_);
+      ops_ = std::exchange(other.ops_, nullptr);
+    }
+  }
+
+  void Reset() noexcept {
+    if (ops_ != nullptr) {
+      std::exchange(ops_, nullptr)->destroy(buffer_);
+    }
+  }
+
+  alignas(std::max_align_t) std::byte buffer_[kBufferSize];
+  const Ops* ops_{nullptr};
+};
+
+}  // namespace klyaksa
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace klyaksa {
+
+/**
+ * Copy of `Histogram` counters which can be merged and queried.
+ */
+struct HistogramSnapshot {
+  // number of sub-buckets per power of two: relative error is 1/8
+  static constexpr std::size_t kSubBucketBits{3};
+  static constexpr std::size_t kSubBuckets{1 << kSubBucketBits};
+  static constexpr std::size_t kBuckets{(64 - kSubBucketBits + 1) *
+                                        kSubBuckets};
+
+  [[nodiscard]] static constexpr std::size_t BucketOf(
+      std::uint64_t value) noexcept {
+    if (value < kSubBuckets) {
+      return static_cast<std::size_t>(value);
+    }
+    const auto msb = static_cast<std::size_t>(std::bit_width(value)) - 1;
+    const auto shift = msb - kSubBucketBits;
+    return (shift + 1) * kSubBuckets +
+           static_cast<std::size_t>((value >> shift) & (kSubBuckets - 1));
+  }
+
+  // the smallest value of the bucket
+  [[nodiscard]] static constexpr std::uint64_t LowerBound(
+      std::size_t bucket) noexcept {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+    const auto shift = bucket / kSubBuckets - 1;
+    return (kSubBuckets + bucket % kSubBuckets) << shift;
+  }
+
+  [[nodiscard]] std::uint64_t Count() const noexcept {
+    std::uint64_t total = 0;
+    for (auto count : counts) {
+      total += count;
+    }
+    return total;
+  }
+
+  [[nodiscard]] double Mean() const noexcept {
+    const auto total = Count();
+    return total == 0 ? 0.0
+                      : static_cast<double>(sum) / static_cast<double>(total);
+  }
+
+  /**
+   * Value which is greater or equal to `percentile` (0..100) of recorded
+   * values up to the bucket precision
+   */
+  [[nodiscard]] std::uint64_t Percentile(double percentile) const noexcept {
+    const auto total = Count();
+    if (total == 0) {
+      return 0;
+    }
+    auto rank = static_cast<std::uint64_t>(percentile / 100.0 *
+                                           static_cast<double>(total));
+    rank = rank == 0 ? 1 : rank;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBuckets; i++) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return i + 1 < kBuckets ? LowerBound(i + 1) - 1 : max;
+      }
+    }
+    return max;
+  }
+
+  HistogramSnapshot& operator+=(const HistogramSnapshot& other) noexcept {
+    for (std::size_t i = 0; i < kBuckets; i++) {
+      counts[i] += other.counts[i];
+    }
+    sum += other.sum;
+    max = max < other.max ? other.max : max;
+    return *this;
+  }
+
+  std::array<std::uint64_t, kBuckets> counts{};
+  std::uint64_t sum{0};
+  std::uint64_t max{0};
+};
+
+/**
+ * HDR-style histogram with logarithmic buckets split into linear
+ * sub-buckets.
+ * Single writer: `Record` is a pair of relaxed load and store so it never
+ * locks or contends; any thread may take `Snapshot`.
+ */
+class Histogram {
+ public:
+  void Record(std::uint64_t value) noexcept {
+    Increment(counts_[HistogramSnapshot::BucketOf(value)], 1);
+    Increment(sum_, value);
+    if (value > max_.load(std::memory_order_relaxed)) {
+      max_.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  [[nodiscard]] HistogramSnapshot Snapshot() const noexcept {
+    HistogramSnapshot snapshot;
+    for (std::size_t i = 0; i < HistogramSnapshot::kBuckets; i++) {
+      snapshot.counts[i] = counts_[i].load(std::memory_order_relaxed);
+    }
+    snapshot.sum = sum_.load(std::memory_order_relaxed);
+    snapshot.max = max_.load(std::memory_order_relaxed);
+    return snapshot;
+  }
+
+ private:
+  static void Increment(std::atomic<std::uint64_t>& counter,
+                        std::uint64_t value) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<std::uint64_t>, HistogramSnapshot::kBuckets>
+      counts_{};
+  std::atomic<std::uint64_t> sum_{0};
+  std::atomic<std::uint64_t> max_{0};
+};
+
+// Statistics of a worker (or their sum), times are in nanoseconds
+struct WorkerStats {
+  std::uint64_t executed{0};
+  // tasks taken from other workers' deques (work-stealing mode)
+  std::uint64_t stolen{0};
+  // times the worker found nothing to do and went to sleep
+  std::uint64_t parks{0};
+  // the rest is collected only with `ThreadPoolOptions::collect_timings`
+  std::chrono::nanoseconds busy{0};
+  std::chrono::nanoseconds idle{0};
+  // enqueue-to-start latency
+  HistogramSnapshot queue_wait;
+  HistogramSnapshot execution;
+
+  WorkerStats& operator+=(const WorkerStats& other) noexcept {
+    executed += other.executed;
+    stolen += other.stolen;
+    parks += other.parks;
+    busy += other.busy;
+    idle += other.idle;
+    queue_wait += other.queue_wait;
+    execution += other.execution;
+    return *this;
+  }
+
+  // share of time spent on tasks
+  [[nodiscard]] double Utilization() const noexcept {
+    const auto total = busy + idle;
+    return total.count() == 0 ? 0.0
+                               : static_cast<double>(busy.count()) /
+                                     static_cast<double>(total.count());
+  }
+};
+
+struct ThreadPoolStats {
+  std::vector<WorkerStats> workers;
+  // sum over `workers`
+  WorkerStats total;
+  std::size_t queue_size{0};
+  std::size_t queue_capacity{0};
+  // tasks waiting in priority lanes
+  std::size_t lane_size{0};
+  std::size_t active_tasks{0};
+  // posts which found the queue full (whatever the overflow policy did)
+  std::uint64_t overflows{0};
+  // running workers and how many were added or retired by elastic sizing
+  std::size_t live_workers{0};
+  std::uint64_t grown{0};
+  std::uint64_t retired{0};
+};
+
+/**
+ * Counters of a single worker: only the worker updates them
+ * so updates are relaxed load/store without read-modify-write.
+ */
+class WorkerCounters {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  void AddExecuted() noexcept { Increment(executed_, 1); }
+
+  void AddStolen() noexcept { Increment(stolen_, 1); }
+
+  void AddPark() noexcept { Increment(parks_, 1); }
+
+  // the worker starts waiting for tasks
+  void StartIdle(Clock::time_point now) noexcept { idle_since_ = now; }
+
+  // the worker took a task enqueued at `enqueued` (if known) at `start`
+  void StartTask(Clock::time_point start,
+                 Clock::time_point enqueued) noexcept {
+    Increment(idle_ns_, Nanoseconds(start - idle_since_));
+    if (enqueued.time_since_epoch().count() != 0) {
+      queue_wait_.Record(Nanoseconds(start - enqueued));
+    }
+  }
+
+  void FinishTask(Clock::time_point start, Clock::time_point end) noexcept {
+    const auto elapsed = Nanoseconds(end - start);
+    Increment(busy_ns_, elapsed);
+    execution_.Record(elapsed);
+    idle_since_ = end;
+  }
+
+  [[nodiscard]] WorkerStats Snapshot() const noexcept {
+    WorkerStats stats;
+    stats.executed = executed_.load(std::memory_order_relaxed);
+    stats.stolen = stolen_.load(std::memory_order_relaxed);
+    stats.parks = parks_.load(std::memory_order_relaxed);
+    stats.busy = std::chrono::nanoseconds{
+        static_cast<std::int64_t>(busy_ns_.load(std::memory_order_relaxed))};
+    stats.idle = std::chrono::nanoseconds{
+        static_cast<std::int64_t>(idle_ns_.load(std::memory_order_relaxed))};
+    stats.queue_wait = queue_wait_.Snapshot();
+    stats.execution = execution_.Snapshot();
+    return stats;
+  }
+
+ private:
+  static std::uint64_t Nanoseconds(Clock::duration elapsed) noexcept {
+    const auto ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    return ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+  }
+
+  static void Increment(std::atomic<std::uint64_t>& counter,
+                        std::uint64_t value) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+
+  std::atomic<std::uint64_t> executed_{0};
+  std::atomic<std::uint64_t> stolen_{0};
+  std::atomic<std::uint64_t> parks_{0};
+  std::atomic<std::uint64_t> busy_ns_{0};
+  std::atomic<std::uint64_t> idle_ns_{0};
+  // the worker's own
+  Clock::time_point idle_since_{};
+  Histogram queue_wait_;
+  Histogram execution_;
+};
+
+}  // namespace klyaksa
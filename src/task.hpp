@@ -1,15 +1,23 @@
 #pragma once
+#include <chrono>
 #include <functional>
 #include <future>
 #include <memory>
 #include <type_traits>
 
+#include "small_function.hpp"
+
 namespace klyaksa {
 
 struct WrongFutureType : public std::runtime_error {
   using std::runtime_error::runtime_error;
 };
 
+// the task was cancelled through its stop token before it started
+struct TaskCancelled : public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
 namespace traits {
 
 // requirements like the std::bind has cuz we need to capture them
@@ -101,8 +109,39 @@ class Task {
 #endif  // _MSC_VER
   }
 
+  /**
+   * Create fire-and-forget task: no promise/future machinery is involved
+   * so the result of the callable is discarded and exceptions it throws
+   * are swallowed by the executor.
+   * Small callables (with bound arguments) don't allocate, see
+   * `SmallFunction`. `GetFuture` of such task throws.
+   */
+  template <traits::Bindable Func, traits::Bindable... Args>
+    requires traits::Taskable<Func, Args...>
+  static Task Detached(Func&& f, Args&&... args) {
+    Task task;
+    task.task_ = [func = std::forward<Func>(f),
+                  ... params = std::forward<Args>(args)]() mutable {
+      std::invoke(func, std::unwrap_reference_t<Args>(params)...);
+    };
+    return task;
+  }
+
   void operator()() { task_(); }
 
+  // false for a default constructed (or moved from) task
+  explicit operator bool() const noexcept { return static_cast<bool>(task_); }
+
+  // time the task was posted to an executor, zero unless it's recorded
+  [[nodiscard]] std::chrono::steady_clock::time_point EnqueueTime()
+      const noexcept {
+    return enqueued_;
+  }
+
+  void SetEnqueueTime(std::chrono::steady_clock::time_point when) noexcept {
+    enqueued_ = when;
+  }
+
   template <class R>
   std::future<R> GetFutureSafetly() {
     auto base = erased_future_.get();
@@ -142,8 +181,9 @@ class Task {
     std::future<R> future_;
   };
 
-  std::move_only_function<void()> task_;
+  SmallFunction task_;
   std::unique_ptr<Concept> erased_future_;
+  std::chrono::steady_clock::time_point enqueued_{};
 };
 
 }  // namespace klyaksa
@@ -0,0 +1,152 @@
+#include "task_graph.hpp"
+
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+namespace klyaksa {
+
+TaskGraph::NodeId TaskGraph::Add(SmallFunction fn,
+                                 std::span<const NodeId> dependencies) {
+  if (running_.load(std::memory_order_acquire)) {
+    throw std::logic_error("task graph is running");
+  }
+  const NodeId id = nodes_.size();
+  for (NodeId dependency : dependencies) {
+    if (dependency >= id) {
+      throw std::invalid_argument("unknown task graph dependency");
+    }
+  }
+  auto& node = nodes_.emplace_back();
+  node.fn = std::move(fn);
+  node.dependencies = dependencies.size();
+  for (NodeId dependency : dependencies) {
+    nodes_[dependency].successors.push_back(id);
+  }
+  if (dependencies.empty()) {
+    roots_.push_back(id);
+  }
+  return id;
+}
+
+std::future<void> TaskGraph::Run(ThreadPool& executor) {
+  if (running_.exchange(true, std::memory_order_acq_rel)) {
+    throw std::logic_error("task graph is running");
+  }
+  done_ = {};
+  auto done = done_.get_future();
+  if (nodes_.empty()) {
+    running_.store(false, std::memory_order_release);
+    done_.set_value();
+    return done;
+  }
+  executor_ = &executor;
+  failed_.store(false, std::memory_order_relaxed);
+  error_ = nullptr;
+  for (auto&& node : nodes_) {
+    node.pending.store(node.dependencies, std::memory_order_relaxed);
+    node.rejected = false;
+  }
+  // posting publishes the reset counters to workers
+  remaining_.store(nodes_.size(), std::memory_order_release);
+  for (NodeId root : roots_) {
+    if (!Schedule(root)) {
+      RunFrom(root);
+    }
+  }
+  return done;
+}
+
+TaskGraph::Pending::~Pending() {
+  if (graph == nullptr || graph->nodes_[id].rejected) {
+    return;
+  }
+  // the node and the nodes it would make ready are only counted down
+  graph->Fail(std::make_exception_ptr(
+      std::future_error{std::future_errc::broken_promise}));
+  graph->RunFrom(id);
+}
+
+bool TaskGraph::Schedule(NodeId id) {
+  auto task = Task::Detached([pending = Pending{this, id}]() mutable {
+    // the graph may be gone once the node is done: disarm before
+    std::exchange(pending.graph, nullptr)->RunFrom(pending.id);
+  });
+  if (executor_->Post(std::move(task))) {
+    return true;
+  }
+  // the task is left to us: its guard must not drop the node
+  nodes_[id].rejected = true;
+  return false;
+}
+
+void TaskGraph::RunFrom(NodeId id) {
+  std::optional<NodeId> next{id};
+  // ready nodes the pool rejected
+  std::vector<NodeId> rejected;
+  while (next || !rejected.empty()) {
+    if (!next) {
+      next = rejected.back();
+      rejected.pop_back();
+    }
+    auto& node = nodes_[*next];
+    next.reset();
+    RunNode(node);
+    for (NodeId successor : node.successors) {
+      // acq_rel: the successor sees results of all its dependencies
+      if (nodes_[successor].pending.fetch_sub(1, std::memory_order_acq_rel) !=
+          1) {
+        continue;
+      }
+      if (!next) {
+        // saves a trip through the queue
+        next = successor;
+      } else if (failed_.load(std::memory_order_relaxed) ||
+                 !Schedule(successor)) {
+        // nodes of a failed run are skipped: no need to post them
+        rejected.push_back(successor);
+      }
+    }
+    // the graph may be gone once the last node is finished
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      Finish();
+      return;
+    }
+  }
+}
+
+void TaskGraph::RunNode(Node& node) noexcept {
+  if (failed_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  try {
+    node.fn();
+  } catch (...) {
+    Fail(std::current_exception());
+  }
+}
+
+void TaskGraph::Fail(std::exception_ptr error) noexcept {
+  std::lock_guard lock{error_mutex_};
+  if (!error_) {
+    error_ = std::move(error);
+  }
+  failed_.store(true, std::memory_order_relaxed);
+}
+
+void TaskGraph::Finish() noexcept {
+  auto done = std::move(done_);
+  std::exception_ptr error;
+  {
+    std::lock_guard lock{error_mutex_};
+    error = std::exchange(error_, nullptr);
+  }
+  running_.store(false, std::memory_order_release);
+  if (error) {
+    done.set_exception(error);
+  } else {
+    done.set_value();
+  }
+}
+
+}  // namespace klyaksa
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <future>
+#include <initializer_list>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "small_function.hpp"
+#include "thread_pool.hpp"
+
+namespace klyaksa {
+
+/**
+ * DAG of steps run on a `ThreadPool` without barriers: a finished node
+ * counts down the dependencies of its successors and posts those which
+ * became ready, the last of them goes on on the same worker.
+ * Nodes may depend only on nodes added before, so the graph can't have
+ * cycles. The graph is built once and may be run many times, but a run
+ * has to finish before the next one, `Add` or destruction.
+ */
+class TaskGraph {
+ public:
+  using NodeId = std::size_t;
+
+  TaskGraph() = default;
+
+  TaskGraph(const TaskGraph&) = delete;
+  TaskGraph& operator=(const TaskGraph&) = delete;
+
+  /**
+   * @param fn step called once per run
+   * @throw std::invalid_argument if a dependency isn't added yet,
+   * std::logic_error if the graph is running
+   */
+  NodeId Add(SmallFunction fn, std::span<const NodeId> dependencies);
+
+  NodeId Add(SmallFunction fn,
+             std::initializer_list<NodeId> dependencies = {}) {
+    return Add(std::move(fn),
+               std::span{dependencies.begin(), dependencies.size()});
+  }
+
+  [[nodiscard]] std::size_t Size() const noexcept { return nodes_.size(); }
+
+  /**
+   * Post nodes without dependencies to `executor`, the rest follow
+   * as they become ready. A node the pool rejects runs on the thread
+   * which made it ready.
+   * @return ready once every node is done; holds the first exception
+   * thrown by a node, nodes which weren't started by then are skipped.
+   * A node task the pool drops unrun (by the overflow policy or `Stop`)
+   * fails the run with `broken_promise`.
+   * @throw std::logic_error if the graph is running
+   */
+  [[nodiscard]] std::future<void> Run(ThreadPool& executor);
+
+ private:
+  struct Node {
+    SmallFunction fn;
+    std::vector<NodeId> successors;
+    std::size_t dependencies{0};
+    // dependencies not finished in the current run
+    std::atomic<std::size_t> pending{0};
+    // the pool rejected the node's task in the current run: the thread
+    // which made it ready runs the node
+    bool rejected{false};
+  };
+
+  // drops the node if its task is destroyed without running
+  struct Pending {
+    Pending(TaskGraph* graph, NodeId id) noexcept : graph{graph}, id{id} {}
+    Pending(Pending&& other) noexcept
+        : graph{std::exchange(other.graph, nullptr)}, id{other.id} {}
+    Pending& operator=(Pending&&) = delete;
+    ~Pending();
+
+    TaskGraph* graph;
+    NodeId id;
+  };
+
+  // post the node or return false if the pool rejected it
+  bool Schedule(NodeId id);
+
+  // run the node and then its ready successors
+  void RunFrom(NodeId id);
+
+  void RunNode(Node& node) noexcept;
+
+  void Fail(std::exception_ptr error) noexcept;
+
+  // the last node of the run completes it
+  void Finish() noexcept;
+
+  std::deque<Node> nodes_;
+  std::vector<NodeId> roots_;
+  ThreadPool* executor_{nullptr};
+  std::atomic<bool> running_{false};
+  // nodes not finished in the current run
+  std::atomic<std::size_t> remaining_{0};
+  std::atomic<bool> failed_{false};
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+  std::promise<void> done_;
+};
+
+}  // namespace klyaksa
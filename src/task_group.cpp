@@ -0,0 +1,78 @@
+#include "task_group.hpp"
+
+#include <chrono>
+#include <future>
+
+namespace klyaksa {
+
+namespace {
+
+// how long a worker with nothing to help sleeps before it looks again
+constexpr std::chrono::microseconds kHelpPollInterval{50};
+
+}  // namespace
+
+TaskGroup::Pending::~Pending() {
+  if (group != nullptr) {
+    group->Fail(std::make_exception_ptr(
+        std::future_error{std::future_errc::broken_promise}));
+    group->Done();
+  }
+}
+
+TaskGroup::~TaskGroup() {
+  try {
+    Wait();
+  } catch (...) {
+    // the owner didn't ask for the error
+  }
+}
+
+void TaskGroup::Wait() {
+  const bool helper = executor_.IsWorkerThread();
+  while (pending_.load(std::memory_order_acquire) != 0) {
+    if (helper && executor_.RunPendingTask()) {
+      continue;
+    }
+    std::unique_lock lock{mutex_};
+    auto done = [this] {
+      return pending_.load(std::memory_order_acquire) == 0;
+    };
+    if (helper) {
+      // tasks of the group run elsewhere: look for new work now and then
+      done_.wait_for(lock, kHelpPollInterval, done);
+    } else {
+      done_.wait(lock, done);
+    }
+  }
+  std::lock_guard lock{mutex_};
+  if (error_) {
+    std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+}
+
+void TaskGroup::Done() noexcept {
+  auto pending = pending_.load(std::memory_order_relaxed);
+  while (pending > 1) {
+    if (pending_.compare_exchange_weak(pending, pending - 1,
+                                       std::memory_order_acq_rel)) {
+      return;
+    }
+  }
+  // the last task decrements under the lock: a waiter which sees zero
+  // takes the lock before it returns so the group can't be destroyed
+  // while we're still here
+  std::lock_guard lock{mutex_};
+  if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    done_.notify_all();
+  }
+}
+
+void TaskGroup::Fail(std::exception_ptr error) noexcept {
+  std::lock_guard lock{mutex_};
+  if (!error_) {
+    error_ = std::move(error);
+  }
+}
+
+}  // namespace klyaksa
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <utility>
+
+#include "task.hpp"
+#include "thread_pool.hpp"
+
+namespace klyaksa {
+
+/**
+ * Tasks posted to a pool which can be waited for together.
+ * A worker of the pool waiting for the group runs queued tasks of the pool
+ * meanwhile instead of blocking, so nested fan-out can't take every worker
+ * out; other threads sleep until the group is done.
+ */
+class TaskGroup {
+ public:
+  explicit TaskGroup(ThreadPool& executor) noexcept : executor_{executor} {}
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  // waits for the tasks, an exception they threw is lost
+  ~TaskGroup();
+
+  /**
+   * Post `f(args...)` as a task of the group. A task the pool rejects runs
+   * on the calling thread.
+   */
+  template <traits::Bindable Func, traits::Bindable... Args>
+  requires traits::Taskable<Func, Args...>
+  void Run(Func&& f, Args&&... args) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    auto task = Task::Detached(
+        [pending = Pending{this},
+         call = Task::Detached(std::forward<Func>(f),
+                               std::forward<Args>(args)...)]() mutable {
+          try {
+            call();
+          } catch (...) {
+            pending.group->Fail(std::current_exception());
+          }
+          std::exchange(pending.group, nullptr)->Done();
+        });
+    if (!executor_.Post(std::move(task))) {
+      task();
+    }
+  }
+
+  /**
+   * Block until every task of the group is done, see the class comment.
+   * The group may be reused afterwards.
+   * @throw the first exception thrown by a task of the group
+   */
+  void Wait();
+
+ private:
+  // a task the pool drops unrun (by the overflow policy or with the pool)
+  // is done with `broken_promise`, like a future of a dropped task
+  struct Pending {
+    explicit Pending(TaskGroup* group) noexcept : group{group} {}
+    Pending(Pending&& other) noexcept
+        : group{std::exchange(other.group, nullptr)} {}
+    Pending& operator=(Pending&&) = delete;
+    ~Pending();
+
+    TaskGroup* group;
+  };
+
+  void Done() noexcept;
+  void Fail(std::exception_ptr error) noexcept;
+
+  ThreadPool& executor_;
+  std::atomic<std::size_t> pending_{0};
+  std::mutex mutex_;
+  std::condition_variable done_;
+  std::exception_ptr error_;
+};
+
+}  // namespace klyaksa
@@ -0,0 +1,144 @@
+#include "task_lanes.hpp"
+
+#include <algorithm>
+
+namespace klyaksa {
+
+bool TaskLanes::TryPush(Task&& task, Priority priority,
+                        Clock::time_point deadline) {
+  const auto now = Clock::now();
+  std::lock_guard lock{mutex_};
+  if (IsFull()) {
+    return false;
+  }
+  PushLocked(std::move(task), priority, deadline, now);
+  return true;
+}
+
+bool TaskLanes::TryPushFor(Task&& task, Priority priority,
+                           Clock::time_point deadline,
+                           std::chrono::milliseconds timeout) {
+  std::unique_lock lock{mutex_};
+  blocked_producers_++;
+  const bool has_room =
+      not_full_.wait_for(lock, timeout, [this]() { return !IsFull(); });
+  blocked_producers_--;
+  if (!has_room) {
+    return false;
+  }
+  PushLocked(std::move(task), priority, deadline, Clock::now());
+  return true;
+}
+
+std::optional<Task> TaskLanes::PushEvictOldest(Task&& task, Priority priority,
+                                               Clock::time_point deadline) {
+  const auto now = Clock::now();
+  std::optional<Task> evicted{};
+  std::lock_guard lock{mutex_};
+  if (IsFull()) {
+    Lane* oldest = nullptr;
+    std::size_t index = 0;
+    for (auto&& lane : lanes_) {
+      for (std::size_t i = 0; i < lane.heap.size(); i++) {
+        if (oldest == nullptr ||
+            lane.heap[i].sequence < oldest->heap[index].sequence) {
+          oldest = &lane;
+          index = i;
+        }
+      }
+    }
+    if (oldest != nullptr) {
+      auto& heap = oldest->heap;
+      evicted.emplace(std::move(heap[index].task));
+      heap[index] = std::move(heap.back());
+      heap.pop_back();
+      std::make_heap(heap.begin(), heap.end(), Later{});
+      size_.fetch_sub(1);
+    }
+  }
+  PushLocked(std::move(task), priority, deadline, now);
+  return evicted;
+}
+
+void TaskLanes::PushLocked(Task&& task, Priority priority,
+                           Clock::time_point deadline, Clock::time_point now) {
+  auto& lane = lanes_[static_cast<std::size_t>(priority)];
+  if (size_.load(std::memory_order_relaxed) == 0) {
+    // the queue had no competition so far: don't count it as waiting
+    QueueServed(now);
+  }
+  if (lane.heap.empty()) {
+    lane.since = now;
+  }
+  lane.heap.push_back({deadline, sequence_++, std::move(task)});
+  std::push_heap(lane.heap.begin(), lane.heap.end(), Later{});
+  size_.fetch_add(1);
+}
+
+std::optional<Task> TaskLanes::PopBeforeQueue(Clock::time_point now) {
+  std::lock_guard lock{mutex_};
+  const auto lane = BestLane(now);
+  if (lane == kPriorityLanes) {
+    return std::nullopt;
+  }
+  const auto queue =
+      StandingOf(static_cast<std::size_t>(Priority::kNormal),
+                 queue_since_.load(std::memory_order_relaxed), now);
+  // a tie goes to the lane: in the normal lane it means a task with
+  // a deadline before those without
+  if (queue < StandingOf(lane, lanes_[lane].since, now)) {
+    return std::nullopt;
+  }
+  return PopLane(lane, now);
+}
+
+std::optional<Task> TaskLanes::Pop(Clock::time_point now) {
+  std::lock_guard lock{mutex_};
+  const auto lane = BestLane(now);
+  if (lane == kPriorityLanes) {
+    return std::nullopt;
+  }
+  return PopLane(lane, now);
+}
+
+TaskLanes::Standing TaskLanes::StandingOf(
+    std::size_t level, Clock::time_point since,
+    Clock::time_point now) const noexcept {
+  const auto waited = now - since;
+  if (aging_.count() > 0 && waited.count() > 0) {
+    const auto raised = static_cast<std::size_t>(waited / aging_);
+    level = raised < level ? level - raised : 0;
+  }
+  return {level, waited};
+}
+
+std::size_t TaskLanes::BestLane(Clock::time_point now) const noexcept {
+  std::size_t best = kPriorityLanes;
+  Standing best_standing{};
+  for (std::size_t lane = 0; lane < kPriorityLanes; lane++) {
+    if (lanes_[lane].heap.empty()) {
+      continue;
+    }
+    const auto standing = StandingOf(lane, lanes_[lane].since, now);
+    if (best == kPriorityLanes || standing < best_standing) {
+      best = lane;
+      best_standing = standing;
+    }
+  }
+  return best;
+}
+
+Task TaskLanes::PopLane(std::size_t lane, Clock::time_point now) {
+  auto& heap = lanes_[lane].heap;
+  std::pop_heap(heap.begin(), heap.end(), Later{});
+  Task task{std::move(heap.back().task)};
+  heap.pop_back();
+  lanes_[lane].since = now;
+  size_.fetch_sub(1);
+  if (blocked_producers_ > 0) {
+    not_full_.notify_one();
+  }
+  return task;
+}
+
+}  // namespace klyaksa
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "task.hpp"
+
+namespace klyaksa {
+
+enum class Priority : std::uint8_t {
+  kHigh,
+  // the level of tasks posted without a priority
+  kNormal,
+  kLow,
+};
+
+inline constexpr std::size_t kPriorityLanes{3};
+
+/**
+ * Prioritized tasks of `ThreadPool`.
+ * Lanes are served in priority order, within a lane the earliest deadline
+ * goes first (tasks without a deadline follow in FIFO order).
+ * The pool's shared FIFO queue takes part as the normal lane of tasks
+ * without deadlines.
+ * Aging: a lane (or the shared queue) which hasn't been served for `aging`
+ * competes one level higher, for `2 * aging` two levels higher and so on;
+ * among equal levels the one which waited longer wins.
+ * All lanes together hold up to `capacity` tasks, the pool applies its
+ * overflow policy to a task which doesn't fit.
+ */
+class TaskLanes {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  TaskLanes(std::chrono::nanoseconds aging, std::size_t capacity)
+      : aging_{aging}, capacity_{capacity} {}
+
+  // @return false if the lanes are full, `task` is left untouched then
+  [[nodiscard]] bool TryPush(Task&& task, Priority priority,
+                             Clock::time_point deadline);
+
+  // wait up to `timeout` for a free slot, `task` is left untouched on failure
+  [[nodiscard]] bool TryPushFor(Task&& task, Priority priority,
+                                Clock::time_point deadline,
+                                std::chrono::milliseconds timeout);
+
+  /**
+   * Push evicting the oldest task of any lane if they are full
+   * (a linear scan: eviction is the rare overflow path)
+   * @return evicted task if any
+   */
+  std::optional<Task> PushEvictOldest(Task&& task, Priority priority,
+                                      Clock::time_point deadline);
+
+  // the best task if it goes before the pool's shared queue
+  [[nodiscard]] std::optional<Task> PopBeforeQueue(Clock::time_point now);
+
+  // the best task of any lane
+  [[nodiscard]] std::optional<Task> Pop(Clock::time_point now);
+
+  // a worker has taken a task from the shared queue (or found it empty)
+  void QueueServed(Clock::time_point now) noexcept {
+    queue_since_.store(now, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] bool Empty() const noexcept { return Size() == 0; }
+
+  [[nodiscard]] std::size_t Size() const noexcept {
+    // seq_cst: sleeping workers check it after announcing themselves
+    return size_.load();
+  }
+
+ private:
+  struct Entry {
+    Clock::time_point deadline;
+    // FIFO order among equal deadlines
+    std::uint64_t sequence;
+    Task task;
+  };
+
+  // heap order: the top is the earliest deadline
+  struct Later {
+    bool operator()(const Entry& lhs, const Entry& rhs) const noexcept {
+      return lhs.deadline != rhs.deadline ? lhs.deadline > rhs.deadline
+                                          : lhs.sequence > rhs.sequence;
+    }
+  };
+
+  struct Lane {
+    std::vector<Entry> heap;
+    // last time the lane was served or got its first task
+    Clock::time_point since{};
+  };
+
+  // level the lane (or the queue) competes at and how long it waits
+  struct Standing {
+    std::size_t level;
+    Clock::duration waited;
+
+    bool operator<(const Standing& other) const noexcept {
+      return level != other.level ? level < other.level
+                                  : waited > other.waited;
+    }
+  };
+
+  [[nodiscard]] Standing StandingOf(std::size_t level, Clock::time_point since,
+                                    Clock::time_point now) const noexcept;
+
+  // non-empty lane with the best standing or `kPriorityLanes`
+  [[nodiscard]] std::size_t BestLane(Clock::time_point now) const noexcept;
+
+  [[nodiscard]] Task PopLane(std::size_t lane, Clock::time_point now);
+
+  // `mutex_` must be held
+  void PushLocked(Task&& task, Priority priority, Clock::time_point deadline,
+                  Clock::time_point now);
+
+  // `mutex_` must be held
+  [[nodiscard]] bool IsFull() const noexcept {
+    return size_.load(std::memory_order_relaxed) >= capacity_;
+  }
+
+  const std::chrono::nanoseconds aging_;
+  const std::size_t capacity_;
+  std::mutex mutex_;
+  // producers blocked in `TryPushFor` wait here
+  std::condition_variable not_full_;
+  std::size_t blocked_producers_{0};
+  std::array<Lane, kPriorityLanes> lanes_;
+  std::uint64_t sequence_{0};
+  std::atomic<std::size_t> size_{0};
+  std::atomic<Clock::time_point> queue_since_{};
+};
+
+}  // namespace klyaksa
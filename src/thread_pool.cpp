@@ -1,37 +1,355 @@
 #include "thread_pool.hpp"
 
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#endif
+
 namespace klyaksa {
 
-ThreadPool::ThreadPool(std::size_t threads)
-    : worker_count_{threads}, workers_{threads} {}
+namespace {
+
+// identifies the pool (and its worker) the current thread belongs to
+struct WorkerContext {
+  const ThreadPool* pool{nullptr};
+  std::size_t index{0};
+  // tasks running on the worker: more than one when a task runs another
+  // by `RunPendingTask`
+  std::size_t depth{0};
+};
+
+thread_local WorkerContext current_worker{};
+
+std::uint64_t NextRandom(std::uint64_t& state) noexcept {
+  // xorshift64
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+// hint to the CPU that we're in a spin-wait loop
+void CpuRelax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_pause();
+#endif
+}
+
+// lower bound of the adaptive spin budget
+constexpr std::uint32_t kMinSpinBudget{16};
+
+// how often a draining `Stop` checks whether workers are done
+constexpr std::chrono::milliseconds kDrainPollInterval{1};
+
+}  // namespace
+
+ThreadPool::ThreadPool(std::size_t threads, ThreadPoolOptions options)
+    : worker_count_{threads},
+      options_{options},
+      pending_tasks_{options.queue_capacity},
+      lanes_{options.priority_aging, options.queue_capacity},
+      workers_(std::max(threads, options.elastic.max_workers)) {
+  for (std::size_t i = 0; i < workers_.size(); i++) {
+    // any non-zero seed works for xorshift
+    workers_[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+    workers_[i].spin_budget = options_.idle.spin;
+    if (options_.work_stealing) {
+      // taking nodes back never allocates
+      workers_[i].spare_nodes.reserve(kLocalQueueSize);
+    }
+  }
+  const bool numa = options_.work_stealing && options_.numa_queues;
+  if (options_.placement == WorkerPlacement::kNone && !numa) {
+    for (auto&& worker : workers_) {
+      worker.cpus = options_.cpus;
+    }
+    return;
+  }
+  const auto topology = CpuTopology::Detect();
+  auto placed = PlaceWorkers(topology, options_.placement, options_.cpus,
+                             workers_.size());
+  for (std::size_t i = 0; i < workers_.size(); i++) {
+    workers_[i].cpus = std::move(placed[i]);
+  }
+  if (numa) {
+    SetupNodeQueues(topology);
+  }
+}
 
 ThreadPool::~ThreadPool() {
   stopped_.store(true, std::memory_order_release);
   pending_tasks_.Halt();
+  JoinWorkers();
+  DiscardTasks();
+}
+
+bool ThreadPool::Post(Task&& task) {
+  Stamp(task);
+  if (options_.work_stealing && current_worker.pool == this) {
+    auto& worker = workers_[current_worker.index];
+    Task* local = AcquireNode(worker, std::move(task));
+    if (worker.local_tasks.Push(local)) {
+      parker_.WakeOne();
+      return true;
+    }
+    // own deque is full: fallback to the shared queue
+    task = std::move(*local);
+    RecycleNode(worker, local);
+  }
+  if (Queue* node = NodeQueue(); node != nullptr) {
+    if (node->TryPush(std::move(task))) {
+      WakeWorker();
+      MaybeGrow();
+      return true;
+    }
+  }
+  if (!pending_tasks_.TryPush(std::move(task))) {
+    return Overflow(std::move(task));
+  }
+  WakeWorker();
+  MaybeGrow();
+  return true;
+}
+
+bool ThreadPool::Post(Task&& task, Priority priority,
+                      std::chrono::steady_clock::time_point deadline) {
+  if (stopped_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  Stamp(task);
+  if (!lanes_.TryPush(std::move(task), priority, deadline)) {
+    const LaneSlot lane{priority, deadline};
+    return Overflow(std::move(task), &lane);
+  }
+  WakeForLanes();
+  MaybeGrow();
+  return true;
+}
+
+std::size_t ThreadPool::PostBatch(std::span<Task> tasks) {
+  for (auto&& task : tasks) {
+    Stamp(task);
+  }
+  auto accepted = pending_tasks_.TryPushN(tasks);
+  if (options_.work_stealing || workers_.size() > worker_count_) {
+    parker_.Wake(accepted);
+  }
+  MaybeGrow();
+  while (accepted < tasks.size() && Overflow(std::move(tasks[accepted]))) {
+    accepted++;
+  }
+  return accepted;
+}
+
+bool ThreadPool::RunPendingTask() {
+  if (!IsWorkerThread()) {
+    return false;
+  }
+  const auto index = current_worker.index;
+  auto task = FindTask(index);
+  if (!task) {
+    return false;
+  }
+  RunTask(index, *task);
+  return true;
+}
+
+std::stop_token ThreadPool::GetStopToken() const {
+  std::lock_guard lock{stop_mutex_};
+  return stop_source_.get_token();
+}
+
+bool ThreadPool::IsWorkerThread() const noexcept {
+  return current_worker.pool == this;
+}
+
+std::uint64_t ThreadPool::AddSpaceListener(SmallFunction listener) {
+  std::lock_guard lock{space_mutex_};
+  space_listeners_.emplace_back(next_listener_, std::move(listener));
+  return next_listener_++;
+}
+
+void ThreadPool::RemoveSpaceListener(std::uint64_t token) {
+  std::lock_guard lock{space_mutex_};
+  std::erase_if(space_listeners_,
+                [token](const auto& entry) { return entry.first == token; });
+}
+
+void ThreadPool::SignalSpace() {
+  // pairs with the store in `WantSpace`: the queue operations in between
+  // are seq_cst (or locked) so either the producer's retry sees the free
+  // slot or the worker sees the request
+  if (!space_wanted_.load() || !space_wanted_.exchange(false)) {
+    return;
+  }
+  std::lock_guard lock{space_mutex_};
+  for (auto&& [token, listener] : space_listeners_) {
+    listener();
+  }
+}
+
+bool ThreadPool::Overflow(Task&& task, const LaneSlot* lane) {
+  overflows_.fetch_add(1, std::memory_order_relaxed);
+  auto policy = options_.overflow_policy;
+  if (policy == OverflowPolicy::kBlock && current_worker.pool == this) {
+    // nobody else may drain the queue: don't deadlock
+    policy = OverflowPolicy::kCallerRuns;
+  }
+  switch (policy) {
+    case OverflowPolicy::kReject:
+      return false;
+    case OverflowPolicy::kBlock:
+      if (lane != nullptr ? !lanes_.TryPushFor(std::move(task), lane->priority,
+                                               lane->deadline,
+                                               options_.block_timeout)
+                          : !pending_tasks_.TryPushFor(
+                                std::move(task), options_.block_timeout)) {
+        return false;
+      }
+      break;
+    case OverflowPolicy::kCallerRuns:
+      Execute(task);
+      return true;
+    case OverflowPolicy::kDiscardNewest: {
+      // destroying the task breaks its promise
+      [[maybe_unused]] Task discarded{std::move(task)};
+      return true;
+    }
+    case OverflowPolicy::kDiscardOldest:
+      if (lane != nullptr) {
+        (void)lanes_.PushEvictOldest(std::move(task), lane->priority,
+                                     lane->deadline);
+      } else {
+        (void)pending_tasks_.PushEvictOldest(std::move(task));
+      }
+      break;
+  }
+  if (lane != nullptr) {
+    WakeForLanes();
+  } else {
+    WakeWorker();
+  }
+  return true;
+}
+
+void ThreadPool::WakeWorker() {
+  // elastic workers park on `parker_` in any mode
+  if (options_.work_stealing || workers_.size() > worker_count_) {
+    parker_.WakeOne();
+  }
+}
+
+void ThreadPool::WakeForLanes() {
+  if (!options_.work_stealing) {
+    // a worker blocked on the shared queue comes back to look at the lanes
+    pending_tasks_.Wake();
+  }
+  WakeWorker();
+}
+
+std::size_t ThreadPool::Backlog() const noexcept {
+  auto backlog = pending_tasks_.Size() + lanes_.Size();
+  for (auto&& queue : node_tasks_) {
+    backlog += queue->Size();
+  }
+  return backlog;
+}
+
+void ThreadPool::MaybeGrow() {
+  const auto& elastic = options_.elastic;
+  if (workers_.size() == worker_count_) {
+    return;
+  }
+  // seq_cst: pairs with the decrement in `Park`, see there
+  const auto live = live_workers_.load();
+  if (live >= workers_.size()) {
+    return;
+  }
+  // posts to a stopped pool only queue tasks: don't track their backlog
+  if (stopped_.load(std::memory_order_acquire)) {
+    return;
+  }
+  using Clock = std::chrono::steady_clock;
+  if (live > 0 && Backlog() <= elastic.queue_depth) {
+    if (backlog_since_.load(std::memory_order_relaxed) != Clock::time_point{}) {
+      backlog_since_.store(Clock::time_point{}, std::memory_order_relaxed);
+    }
+    return;
+  }
+  const auto now = Clock::now();
+  auto since = backlog_since_.load(std::memory_order_relaxed);
+  if (since == Clock::time_point{}) {
+    (void)backlog_since_.compare_exchange_strong(since, now,
+                                                 std::memory_order_relaxed);
+    if (live > 0) {
+      return;
+    }
+  }
+  if (live > 0 && now - since < elastic.queue_age) {
+    return;
+  }
+  std::lock_guard lock{elastic_mutex_};
+  if (stopped_.load(std::memory_order_acquire) ||
+      live_workers_.load() >= workers_.size()) {
+    return;
+  }
+  for (auto i = worker_count_; i < workers_.size(); i++) {
+    auto& worker = workers_[i];
+    if (worker.running) {
+      continue;
+    }
+    if (worker.thread.joinable()) {
+      // retired: the thread is about to exit
+      worker.thread.join();
+    }
+    worker.running = true;
+    live_workers_.fetch_add(1);
+    grown_.fetch_add(1, std::memory_order_relaxed);
+    // the next worker needs the backlog to last again
+    backlog_since_.store(now, std::memory_order_relaxed);
+    StartWorker(i);
+    return;
+  }
+}
+
+void ThreadPool::StartWorker(std::size_t index) {
+  running_threads_.fetch_add(1);
+  auto worker = [this, index](std::stop_token stop) {
+    (void)PinCurrentThread(workers_[index].cpus);
+    if (options_.work_stealing || index >= worker_count_) {
+      WorkStealing(std::move(stop), index);
+    } else {
+      Work(std::move(stop), index);
+    }
+    running_threads_.fetch_sub(1);
+  };
+  workers_[index].thread = std::jthread{std::move(worker)};
 }
 
 void ThreadPool::Start() {
+  {
+    std::lock_guard lock{stop_mutex_};
+    if (stop_source_.stop_requested()) {
+      stop_source_ = std::stop_source{};
+    }
+  }
+  draining_.store(false);
   pending_tasks_.Resume();
   for (std::size_t i = 0; i < worker_count_; i++) {
-    auto worker = [this](std::stop_token stop) {
-      while (!stop.stop_requested()) {
-        try {
-          auto top = pending_tasks_.TryPop();
-          if (!top) {
-            // TODO: maybe queue sentinel is gone
-            continue;
-          }
-          active_tasks_.fetch_add(1, std::memory_order_relaxed);
-          std::invoke(*top);
-          active_tasks_.fetch_sub(1, std::memory_order_release);
-        } catch (...) {
-          // TODO: log error
-        }
-      }
-    };
-    workers_[i] = std::jthread{std::move(worker)};
+    StartWorker(i);
   }
-  stopped_.store(false, std::memory_order_release);
+  live_workers_.store(worker_count_);
+  // seq_cst: pairs with `WantSpace` of a producer which saw the pool
+  // stopped, it's called back for the free capacity of a started pool
+  stopped_.store(false);
+  SignalSpace();
 }
 
 void ThreadPool::Stop() {
@@ -41,12 +359,435 @@ void ThreadPool::Stop() {
   stopped_.store(true, std::memory_order_release);
 
   pending_tasks_.Halt();
+  JoinWorkers();
+}
+
+bool ThreadPool::Stop(StopMode mode, std::chrono::milliseconds timeout) {
+  bool drained = true;
+  if (!stopped_.load(std::memory_order_acquire)) {
+    if (mode == StopMode::kDrain) {
+      drained = Drain(timeout);
+    }
+    ThreadPool::Stop();
+  }
+  if (mode == StopMode::kDiscard || !drained) {
+    DiscardTasks();
+  }
+  return drained;
+}
+
+bool ThreadPool::Drain(std::chrono::milliseconds timeout) {
+  using Clock = std::chrono::steady_clock;
+  const auto deadline = timeout == std::chrono::milliseconds::max()
+                            ? Clock::time_point::max()
+                            : Clock::now() + timeout;
+  // seq_cst: a worker going to park either sees the flag
+  // or is woken up below
+  draining_.store(true);
+  // blocking pops return once the queue is empty
+  pending_tasks_.Halt();
+  parker_.WakeAll();
+  while (running_threads_.load() != 0) {
+    if (Clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(kDrainPollInterval);
+  }
+  return true;
+}
+
+void ThreadPool::DiscardTasks() {
+  // destroying a task breaks its promise
+  while (pending_tasks_.Poll()) {
+  }
+  for (auto&& queue : node_tasks_) {
+    while (queue->Poll()) {
+    }
+  }
+  const auto now = std::chrono::steady_clock::now();
+  while (lanes_.Pop(now)) {
+  }
+  for (auto&& worker : workers_) {
+    while (Task* task = worker.local_tasks.Pop()) {
+      delete task;
+    }
+  }
+}
+
+void ThreadPool::JoinWorkers() {
+  {
+    // no elastic worker starts once the pool is stopped
+    std::lock_guard lock{elastic_mutex_};
+    for (auto&& worker : workers_) {
+      worker.thread.request_stop();
+      worker.running = false;
+    }
+  }
+  // after the workers' stop: a task which returns on the token
+  // isn't followed by another one
+  std::stop_source source;
+  {
+    std::lock_guard lock{stop_mutex_};
+    source = stop_source_;
+  }
+  // out of the lock: stop callbacks may ask for the token
+  source.request_stop();
+  parker_.WakeAll();
   for (auto&& worker : workers_) {
-    if (worker.joinable()) {
-      worker.request_stop();
-      worker.join();
+    if (worker.thread.joinable()) {
+      worker.thread.join();
+    }
+  }
+  live_workers_.store(0);
+}
+
+void ThreadPool::Work(std::stop_token stop, std::size_t index) {
+  current_worker = WorkerContext{this, index};
+  if (options_.collect_timings) {
+    workers_[index].stats.StartIdle(std::chrono::steady_clock::now());
+  }
+  while (!stop.stop_requested()) {
+    auto top = lanes_.Empty() ? std::nullopt : PollShared();
+    if (!top) {
+      top = Spin(index);
+    }
+    if (!top) {
+      // park on the queue
+      bool blocked = false;
+      top = pending_tasks_.TryPop(blocked);
+      if (blocked) {
+        workers_[index].stats.AddPark();
+      }
+    }
+    if (!top) {
+      // a lane task may be pushed after the look at the lanes above
+      if (draining_.load() && Backlog() == 0) {
+        break;
+      }
+      // halted queue or a wake-up to look at the lanes
+      continue;
+    }
+    RunTask(index, *top);
+  }
+  current_worker = WorkerContext{};
+}
+
+void ThreadPool::WorkStealing(std::stop_token stop, std::size_t index) {
+  current_worker = WorkerContext{this, index};
+  if (options_.collect_timings) {
+    workers_[index].stats.StartIdle(std::chrono::steady_clock::now());
+  }
+  while (!stop.stop_requested()) {
+    auto task = FindTask(index);
+    if (!task) {
+      task = Spin(index);
+    }
+    if (!task) {
+      const auto epoch = parker_.PrepareWait();
+      // look again: a producer either sees us sleeping or we see its task
+      task = FindTask(index);
+      if (!task && draining_.load()) {
+        parker_.CancelWait();
+        break;
+      }
+      if (!task) {
+        if (!Park(epoch, stop, index, task)) {
+          break;
+        }
+        if (!task) {
+          continue;
+        }
+      } else {
+        parker_.CancelWait();
+      }
+    }
+    RunTask(index, *task);
+  }
+  current_worker = WorkerContext{};
+}
+
+bool ThreadPool::Park(std::uint64_t epoch, const std::stop_token& stop,
+                      std::size_t index, std::optional<Task>& task) {
+  auto& stats = workers_[index].stats;
+  if (index < worker_count_) {
+    if (parker_.Wait(epoch, stop)) {
+      stats.AddPark();
+    }
+    return true;
+  }
+  bool blocked = false;
+  const bool woken =
+      parker_.WaitFor(epoch, stop, options_.elastic.keep_alive, blocked);
+  if (blocked) {
+    stats.AddPark();
+  }
+  if (woken || stop.stop_requested()) {
+    return true;
+  }
+  std::lock_guard lock{elastic_mutex_};
+  if (!workers_[index].running) {
+    // the pool is stopping
+    return true;
+  }
+  // seq_cst: a producer which pushed a task before the look below
+  // either sees fewer workers (and starts one if none is left)
+  // or we find its task
+  live_workers_.fetch_sub(1);
+  task = FindTask(index);
+  if (task) {
+    live_workers_.fetch_add(1);
+    return true;
+  }
+  workers_[index].running = false;
+  retired_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+std::optional<Task> ThreadPool::Spin(std::size_t index) {
+  const auto& idle = options_.idle;
+  auto& worker = workers_[index];
+  auto poll = [this, index]() -> std::optional<Task> {
+    if (!MayHaveWork(index)) {
+      return std::nullopt;
+    }
+    return options_.work_stealing ? FindTask(index) : PollShared();
+  };
+  for (std::uint32_t i = 0; i < worker.spin_budget; i++) {
+    if (auto task = poll(); task) {
+      if (idle.adaptive) {
+        worker.spin_budget = std::min(idle.spin, worker.spin_budget * 2);
+      }
+      return task;
     }
+    CpuRelax();
+  }
+  for (std::uint32_t i = 0; i < idle.yield; i++) {
+    std::this_thread::yield();
+    if (auto task = poll(); task) {
+      return task;
+    }
+  }
+  if (idle.adaptive) {
+    worker.spin_budget = std::max(std::min(kMinSpinBudget, idle.spin),
+                                  worker.spin_budget / 2);
+  }
+  return std::nullopt;
+}
+
+bool ThreadPool::MayHaveWork(std::size_t index) const noexcept {
+  if (pending_tasks_.Size() > 0 || !lanes_.Empty()) {
+    return true;
+  }
+  if (!options_.work_stealing) {
+    return false;
+  }
+  // own deque comes first as the most likely place
+  return workers_[index].local_tasks.Size() > 0 ||
+         std::any_of(workers_.begin(), workers_.end(),
+                     [](auto&& worker) {
+                       return worker.local_tasks.Size() > 0;
+                     }) ||
+         std::any_of(node_tasks_.begin(), node_tasks_.end(),
+                     [](auto&& queue) { return queue->Size() > 0; });
+}
+
+std::optional<Task> ThreadPool::FindTask(std::size_t index) {
+  if (!options_.work_stealing) {
+    // an elastic worker of the blocking mode
+    return PollShared();
+  }
+  if (Task* local = workers_[index].local_tasks.Pop()) {
+    return Unwrap(workers_[index], local);
+  }
+  if (const auto node = workers_[index].node; node >= 0) {
+    if (auto task = node_tasks_[static_cast<std::size_t>(node)]->Poll(); task) {
+      return task;
+    }
+  }
+  if (auto shared = PollShared(); shared) {
+    return shared;
+  }
+  if (auto stolen = Steal(index); stolen) {
+    return stolen;
+  }
+  return PollOtherNodes(index);
+}
+
+std::optional<Task> ThreadPool::PollShared() {
+  if (lanes_.Empty()) {
+    return pending_tasks_.Poll();
+  }
+  const auto now = std::chrono::steady_clock::now();
+  if (auto task = lanes_.PopBeforeQueue(now); task) {
+    return task;
+  }
+  auto task = pending_tasks_.Poll();
+  lanes_.QueueServed(now);
+  return task ? std::move(task) : lanes_.Pop(now);
+}
+
+std::optional<Task> ThreadPool::Steal(std::size_t thief) {
+  // scan every victim starting from a random one: the worker
+  // may go to sleep afterwards so nobody can be skipped;
+  // with node queues the first pass is over the thief's node
+  const auto node = workers_[thief].node;
+  const auto count = workers_.size();
+  const auto first = NextRandom(workers_[thief].seed) % count;
+  for (bool same_node : {true, false}) {
+    for (std::size_t i = 0; i < count; i++) {
+      const auto victim = (first + i) % count;
+      const bool near = node < 0 || workers_[victim].node == node;
+      if (victim == thief || near != same_node) {
+        continue;
+      }
+      if (Task* stolen = workers_[victim].local_tasks.Steal()) {
+        workers_[thief].stats.AddStolen();
+        return Unwrap(workers_[thief], stolen);
+      }
+    }
+    if (node < 0) {
+      break;
+    }
+  }
+  return std::nullopt;
+}
+
+Task* ThreadPool::AcquireNode(Worker& worker, Task&& task) {
+  if (worker.spare_nodes.empty()) {
+    return new Task{std::move(task)};
+  }
+  Task* node = worker.spare_nodes.back().release();
+  worker.spare_nodes.pop_back();
+  *node = std::move(task);
+  return node;
+}
+
+void ThreadPool::RecycleNode(Worker& worker, Task* node) {
+  std::unique_ptr<Task> spare{node};
+  if (worker.spare_nodes.size() < kLocalQueueSize) {
+    worker.spare_nodes.push_back(std::move(spare));
+  }
+}
+
+std::optional<Task> ThreadPool::Unwrap(Worker& worker, Task* node) {
+  std::optional<Task> task{std::move(*node)};
+  RecycleNode(worker, node);
+  return task;
+}
+
+void ThreadPool::SetupNodeQueues(const CpuTopology& topology) {
+  // dense indices of nodes which have workers
+  std::vector<int> nodes;
+  for (auto&& worker : workers_) {
+    if (worker.cpus.empty()) {
+      continue;
+    }
+    const auto node = topology.NodeOf(worker.cpus.front());
+    const bool single = std::all_of(
+        worker.cpus.begin(), worker.cpus.end(),
+        [&topology, node](int cpu) { return topology.NodeOf(cpu) == node; });
+    if (node < 0 || !single) {
+      continue;
+    }
+    auto it = std::find(nodes.begin(), nodes.end(), node);
+    worker.node = static_cast<int>(it - nodes.begin());
+    if (it == nodes.end()) {
+      nodes.push_back(node);
+      node_tasks_.push_back(std::make_unique<Queue>(options_.queue_capacity));
+    }
+  }
+  for (auto&& info : topology.cpus) {
+    const auto cpu = static_cast<std::size_t>(info.cpu);
+    if (cpu >= cpu_nodes_.size()) {
+      cpu_nodes_.resize(cpu + 1, -1);
+    }
+    auto it = std::find(nodes.begin(), nodes.end(), info.node);
+    cpu_nodes_[cpu] = it != nodes.end() ? static_cast<int>(it - nodes.begin())
+                                        : -1;
+  }
+}
+
+ThreadPool::Queue* ThreadPool::NodeQueue() noexcept {
+  if (node_tasks_.empty()) {
+    return nullptr;
+  }
+  int node = -1;
+  if (current_worker.pool == this) {
+    node = workers_[current_worker.index].node;
+  } else if (const auto cpu = CurrentCpu();
+             cpu >= 0 && static_cast<std::size_t>(cpu) < cpu_nodes_.size()) {
+    node = cpu_nodes_[static_cast<std::size_t>(cpu)];
+  }
+  return node >= 0 ? node_tasks_[static_cast<std::size_t>(node)].get()
+                   : nullptr;
+}
+
+std::optional<Task> ThreadPool::PollOtherNodes(std::size_t index) {
+  for (std::size_t node = 0; node < node_tasks_.size(); node++) {
+    if (static_cast<int>(node) == workers_[index].node) {
+      continue;
+    }
+    if (auto task = node_tasks_[node]->Poll(); task) {
+      return task;
+    }
+  }
+  return std::nullopt;
+}
+
+void ThreadPool::Execute(Task& task) {
+  active_tasks_.fetch_add(1, std::memory_order_relaxed);
+  try {
+    std::invoke(task);
+  } catch (...) {
+    // TODO: log error
+    // Note: only detached tasks throw, others keep exception in the future
+  }
+  active_tasks_.fetch_sub(1, std::memory_order_release);
+}
+
+void ThreadPool::RunTask(std::size_t index, Task& task) {
+  SignalSpace();
+  auto& stats = workers_[index].stats;
+  // a nested task runs within the busy time of the outer one
+  const bool timed = options_.collect_timings && current_worker.depth == 0;
+  current_worker.depth++;
+  if (!timed) {
+    Execute(task);
+  } else {
+    const auto start = std::chrono::steady_clock::now();
+    stats.StartTask(start, task.EnqueueTime());
+    Execute(task);
+    stats.FinishTask(start, std::chrono::steady_clock::now());
+  }
+  current_worker.depth--;
+  stats.AddExecuted();
+}
+
+void ThreadPool::Stamp(Task& task) const {
+  if (options_.collect_timings) {
+    task.SetEnqueueTime(std::chrono::steady_clock::now());
+  }
+}
+
+ThreadPoolStats ThreadPool::Snapshot() const {
+  ThreadPoolStats stats;
+  stats.workers.reserve(workers_.size());
+  for (auto&& worker : workers_) {
+    stats.workers.push_back(worker.stats.Snapshot());
+    stats.total += stats.workers.back();
+  }
+  stats.queue_size = pending_tasks_.Size();
+  for (auto&& queue : node_tasks_) {
+    stats.queue_size += queue->Size();
   }
+  stats.queue_capacity = pending_tasks_.Capacity();
+  stats.lane_size = lanes_.Size();
+  stats.active_tasks = GetActiveTasks();
+  stats.overflows = overflows_.load(std::memory_order_relaxed);
+  stats.live_workers = LiveWorkers();
+  stats.grown = grown_.load(std::memory_order_relaxed);
+  stats.retired = retired_.load(std::memory_order_relaxed);
+  return stats;
 }
 
 }  // namespace klyaksa
@@ -1,28 +1,152 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <concepts>
+#include <coroutine>
 #include <cstdint>
 #include <functional>
 #include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
+#include <stop_token>
 #include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "ccqueue.hpp"
+#include "lfqueue.hpp"
+#include "parker.hpp"
+#include "stats.hpp"
 #include "task.hpp"
+#include "task_lanes.hpp"
+#include "topology.hpp"
+#include "ws_deque.hpp"
 
 namespace klyaksa {
 
+class ScheduleAwaitable;
+
+// What `ThreadPool::Post` does when the task queue is full
+enum class OverflowPolicy {
+  // return false and leave the task to the caller
+  kReject,
+  // wait for a free slot up to `ThreadPoolOptions::block_timeout`
+  // Note: worker of the pool never blocks on its own queue, it runs the task
+  kBlock,
+  // execute the task on the submitting thread
+  kCallerRuns,
+  // drop the submitted task: its future reports `broken_promise`
+  kDiscardNewest,
+  // drop the oldest queued task (its future reports `broken_promise`)
+  // to make room for the submitted one
+  kDiscardOldest,
+};
+
+// What `ThreadPool::Stop(StopMode, ...)` does with queued tasks
+enum class StopMode {
+  // run queued tasks (and the tasks they post) before workers exit
+  kDrain,
+  // drop queued tasks: their futures report `broken_promise`
+  kDiscard,
+};
+
+// capacity of the pool's shared task queue unless it's configured
+inline constexpr std::size_t kDefaultQueueCapacity{255};
+// queue capacity without limit: the queue grows by recycled segments
+// Note: not supported by the lock-free queue
+inline constexpr std::size_t kUnboundedQueue{
+    std::numeric_limits<std::size_t>::max()};
+
+/**
+ * What an idle worker does before it goes to sleep: sleeping and waking up
+ * costs a syscall round trip, spinning costs CPU time.
+ * By default a worker parks right away.
+ */
+struct IdleStrategy {
+  // checks for work with a CPU pause between them
+  std::uint32_t spin{0};
+  // checks for work with `std::this_thread::yield` between them
+  std::uint32_t yield{0};
+  /**
+   * Treat `spin` as upper bound of the worker's budget: it's doubled when
+   * spinning finds work and halved when the worker has to park anyway.
+   */
+  bool adaptive{false};
+};
+
+/**
+ * Elastic sizing: workers beyond the constructor's count are started
+ * while the backlog stays deep and retire when they run out of work.
+ */
+struct ElasticOptions {
+  // upper bound of workers, the pool has a fixed size unless it's greater
+  // than the constructor's count
+  std::size_t max_workers{0};
+  // tasks waiting in the shared queues and lanes which make a backlog
+  std::size_t queue_depth{32};
+  // another worker is started each time the backlog lasts that long
+  std::chrono::microseconds queue_age{500};
+  // an added worker which found no work for that long retires
+  std::chrono::milliseconds keep_alive{1000};
+};
+
+struct ThreadPoolOptions {
+  // capacity of the shared task queue, may be `kUnboundedQueue`
+  std::size_t queue_capacity{kDefaultQueueCapacity};
+  OverflowPolicy overflow_policy{OverflowPolicy::kReject};
+  // used only by `OverflowPolicy::kBlock`
+  std::chrono::milliseconds block_timeout{100};
+  /**
+   * Every worker owns a deque: tasks posted from a worker go to its own deque,
+   * tasks posted from outside go to the shared queue and
+   * idle workers steal from randomly chosen victims.
+   */
+  bool work_stealing{false};
+  IdleStrategy idle{};
+  /**
+   * Record busy/idle time of workers and histograms of queue wait and
+   * execution time: costs a few clock reads per task.
+   */
+  bool collect_timings{false};
+  // anti-starvation aging of priority lanes, see `TaskLanes`
+  std::chrono::milliseconds priority_aging{10};
+  // CPUs workers may run on, every CPU of the process when empty
+  std::vector<int> cpus{};
+  WorkerPlacement placement{WorkerPlacement::kNone};
+  /**
+   * Work-stealing mode: a queue per NUMA node of the workers' CPUs.
+   * Tasks posted from outside go to the queue of the poster's node,
+   * workers look at their node's queue and victims before the others.
+   * Needs `placement` (or `cpus` within a single node) to tie workers
+   * to nodes.
+   */
+  bool numa_queues{false};
+  ElasticOptions elastic{};
+};
+
 /// execution context
 class ThreadPool {
  public:
-  static constexpr std::size_t kTaskQueueSize{255};
+  static constexpr std::size_t kTaskQueueSize{kDefaultQueueCapacity};
+  // capacity of a worker's own deque in work-stealing mode
+  static constexpr std::size_t kLocalQueueSize{1024};
 
-  using Queue = CcQueue<Task, kTaskQueueSize>;
+#ifdef KLYAKSA_LOCK_FREE_QUEUE
+  using Queue = LfQueue<Task>;
+#else
+  using Queue = CcQueue<Task>;
+#endif  // KLYAKSA_LOCK_FREE_QUEUE
 
-  ThreadPool(std::size_t threads);
+  /**
+   * @throw std::invalid_argument if the queue can't have
+   * `options.queue_capacity` slots
+   */
+  ThreadPool(std::size_t threads, ThreadPoolOptions options = {});
 
   ThreadPool(const ThreadPool&) = delete;
   ThreadPool& operator=(const ThreadPool&) = delete;
@@ -33,13 +157,69 @@ class ThreadPool {
   virtual ~ThreadPool();
 
   /**
-   * Post already created task
-   * @return true if task was successfully added
+   * Post already created task.
+   * In work-stealing mode a task posted from a worker of this pool
+   * goes to the worker's own deque unless it's full.
+   * When the queue is full the `OverflowPolicy` decides task's fate.
+   * @return true if task was added, executed or discarded by the policy;
+   * false if it was rejected (the task is left untouched)
    */
-  [[nodiscard]] bool Post(Task&& task) noexcept(
-      noexcept(std::declval<Queue>().TryPush(std::declval<Task>()))) {
-    return pending_tasks_.TryPush(std::move(task));
-  }
+  [[nodiscard]] bool Post(Task&& task);
+
+  /**
+   * Post to a priority lane: workers take the most urgent task of
+   * the lanes and the shared queue (which holds tasks without a priority,
+   * see `TaskLanes`). The lanes hold up to `queue_capacity` tasks together,
+   * when they are full the `OverflowPolicy` decides task's fate.
+   * Unlike the shared queue they don't take tasks while the pool is stopped.
+   * @param deadline orders tasks of the lane, earliest first
+   * @return the same as `Post(Task&&)`, false for a stopped pool
+   */
+  [[nodiscard]] bool Post(Task&& task, Priority priority,
+                          std::chrono::steady_clock::time_point deadline =
+                              std::chrono::steady_clock::time_point::max());
+
+  /**
+   * Post tasks from the front of `tasks`: those which fit the queue
+   * are pushed under a single queue lock and at most as many idle workers
+   * as pushed tasks are woken up, the rest go through the `OverflowPolicy`
+   * one by one until it rejects one of them.
+   * @return number of tasks from the front which were added, executed
+   * or discarded by the policy; the rest are left untouched in `tasks`
+   */
+  [[nodiscard]] std::size_t PostBatch(std::span<Task> tasks);
+
+  /**
+   * Take a queued task (own deque, shared queues and lanes, other workers)
+   * and run it on the calling worker, e.g. while it waits for subtasks.
+   * @return false if the caller isn't a worker of this pool
+   * or there's nothing to run
+   */
+  bool RunPendingTask();
+
+  // the calling thread is a worker of this pool
+  [[nodiscard]] bool IsWorkerThread() const noexcept;
+
+  // `co_await executor.Schedule()` resumes the coroutine on a worker
+  [[nodiscard]] ScheduleAwaitable Schedule() noexcept;
+
+  /**
+   * `listener` is called by a worker which takes a task after `WantSpace()`
+   * (or by `Start()` of a stopped pool) so a producer which can't block
+   * may wait for free capacity without polling. Every listener is called:
+   * the pool doesn't know which one asked for it.
+   * @return token for `RemoveSpaceListener`
+   */
+  [[nodiscard]] std::uint64_t AddSpaceListener(SmallFunction listener);
+
+  // waits for the listener to return if it is running
+  void RemoveSpaceListener(std::uint64_t token);
+
+  /**
+   * Ask for a single call of the listener. Call it before the last attempt
+   * to post: a task taken after that attempt triggers the listener.
+   */
+  void WantSpace() noexcept { space_wanted_.store(true); }
 
   /**
    * Not atomic operations so:
@@ -56,28 +236,289 @@ class ThreadPool {
    */
   virtual void Stop();
 
+  /**
+   * Stop the pool: stop is requested on `GetStopToken()` and workers exit
+   * after their running task.
+   * `kDrain` runs queued tasks first, the rest of them is discarded once
+   * `timeout` expires; a stopped pool doesn't drain.
+   * Thread requirements are the same as for `Stop()`.
+   * @return false if the drain timed out
+   */
+  virtual bool Stop(StopMode mode, std::chrono::milliseconds timeout =
+                                       std::chrono::milliseconds::max());
+
+  // token stop is requested on when the pool stops, renewed by `Start`;
+  // may be called from any thread
+  [[nodiscard]] std::stop_token GetStopToken() const;
+
   virtual bool IsStopped() const noexcept {
     return stopped_.load(std::memory_order_acquire);
   }
 
+  // workers started by `Start`, see `ElasticOptions` for the rest
   std::size_t WorkerCount() const noexcept { return worker_count_; }
 
+  std::size_t LiveWorkers() const noexcept {
+    return live_workers_.load(std::memory_order_relaxed);
+  }
+
+  std::size_t QueueCapacity() const noexcept {
+    return pending_tasks_.Capacity();
+  }
+
   std::size_t GetActiveTasks() const noexcept {
     return active_tasks_.load(std::memory_order_acquire);
   }
 
+  /**
+   * Collect statistics of every worker and the queue.
+   * Counters are read one by one without stopping workers
+   * so the snapshot isn't atomic.
+   */
+  [[nodiscard]] ThreadPoolStats Snapshot() const;
+
  private:
+  using LocalQueue = WsDeque<Task, kLocalQueueSize>;
+
+  struct Worker {
+    // used only in work-stealing mode
+    LocalQueue local_tasks;
+    // state of the xorshift generator used to pick victims
+    std::uint64_t seed{0};
+    // current number of spins of `IdleStrategy`
+    std::uint32_t spin_budget{0};
+    // affinity of the worker thread, not pinned when empty
+    std::vector<int> cpus;
+    // nodes of `local_tasks` ready for reuse so posting from a task
+    // doesn't allocate; only the worker's own thread takes and returns them
+    // (a thief keeps the nodes it steals)
+    std::vector<std::unique_ptr<Task>> spare_nodes;
+    // index in `node_tasks_` or -1
+    int node{-1};
+    // an elastic worker's thread is running (it may be retired but
+    // not joined yet when false)
+    bool running{false};
+    WorkerCounters stats;
+    std::jthread thread;
+  };
+
+  // Worker loop which blocks on the shared queue
+  void Work(std::stop_token stop, std::size_t index);
+
+  // Worker loop of work-stealing mode and of elastic workers
+  // which parks on `parker_`
+  void WorkStealing(std::stop_token stop, std::size_t index);
+
+  void StartWorker(std::size_t index);
+
+  /**
+   * Sleep on `parker_` after `PrepareWait`, an elastic worker retires
+   * after `ElasticOptions::keep_alive` unless it finds a task then
+   * @return false if the worker has retired
+   */
+  bool Park(std::uint64_t epoch, const std::stop_token& stop,
+            std::size_t index, std::optional<Task>& task);
+
+  // tasks waiting in the shared queues and lanes
+  std::size_t Backlog() const noexcept;
+
+  // start an elastic worker if the backlog lasts long enough
+  void MaybeGrow();
+
+  // local deque, shared queue and then other workers
+  std::optional<Task> FindTask(std::size_t index);
+
+  // shared queue and priority lanes in their order
+  std::optional<Task> PollShared();
+
+  std::optional<Task> Steal(std::size_t thief);
+
+  // a node of the worker's deque holding `task`, allocated if none is spare
+  static Task* AcquireNode(Worker& worker, Task&& task);
+
+  // keep the node for reuse by the worker or free it
+  static void RecycleNode(Worker& worker, Task* node);
+
+  // take the task out of a node popped or stolen by the worker
+  static std::optional<Task> Unwrap(Worker& worker, Task* node);
+
+  // create node queues for NUMA nodes the workers are tied to
+  void SetupNodeQueues(const CpuTopology& topology);
+
+  // queue of the current thread's NUMA node or nullptr
+  Queue* NodeQueue() noexcept;
+
+  // a task of a node queue other than the worker's own
+  std::optional<Task> PollOtherNodes(std::size_t index);
+
+  // run `IdleStrategy` checking for work: nullopt means it's time to park
+  std::optional<Task> Spin(std::size_t index);
+
+  // cheap check whether work may be available for the worker
+  bool MayHaveWork(std::size_t index) const noexcept;
+
+  void Execute(Task& task);
+
+  // execute the task on the worker recording statistics
+  void RunTask(std::size_t index, Task& task);
+
+  // stamp the task before it's queued if timings are collected
+  void Stamp(Task& task) const;
+
+  // where a task which doesn't fit the priority lanes goes
+  struct LaneSlot {
+    Priority priority;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  // apply overflow policy to the task which doesn't fit the shared queue
+  // or the lanes if `lane` is given
+  bool Overflow(Task&& task, const LaneSlot* lane = nullptr);
+
+  // wake up a parked worker if a mode needs it
+  void WakeWorker();
+
+  // wake up a worker for a task pushed to the lanes
+  void WakeForLanes();
+
+  // call the space listener if it was asked for
+  void SignalSpace();
+
+  // request stop, wake up and join all workers
+  void JoinWorkers();
+
+  // let workers exit once they find no task, wait for them up to `timeout`
+  bool Drain(std::chrono::milliseconds timeout);
+
+  // drop every queued task of stopped workers
+  void DiscardTasks();
+
   const std::size_t worker_count_{0};
+  const ThreadPoolOptions options_;
   std::atomic<bool> stopped_{true};
+  // guards `stop_source_`: `Start` replaces it under producers' feet
+  mutable std::mutex stop_mutex_;
+  std::stop_source stop_source_;
+  // see `Drain`
+  std::atomic<bool> draining_{false};
+  // worker threads which haven't left their loop yet
+  std::atomic<std::size_t> running_threads_{0};
   // number of tasks currently running
   std::atomic<std::size_t> active_tasks_{0};
+  std::atomic<std::uint64_t> overflows_{0};
+  // guards starting and retiring of elastic workers
+  std::mutex elastic_mutex_;
+  std::atomic<std::size_t> live_workers_{0};
+  // when the backlog got deep, zero time point if it isn't
+  std::atomic<std::chrono::steady_clock::time_point> backlog_since_{};
+  std::atomic<std::uint64_t> grown_{0};
+  std::atomic<std::uint64_t> retired_{0};
+  std::atomic<bool> space_wanted_{false};
+  std::mutex space_mutex_;
+  std::vector<std::pair<std::uint64_t, SmallFunction>> space_listeners_;
+  std::uint64_t next_listener_{0};
   Queue pending_tasks_;
-  std::vector<std::jthread> workers_;
+  TaskLanes lanes_;
+  // see `ThreadPoolOptions::numa_queues`
+  std::vector<std::unique_ptr<Queue>> node_tasks_;
+  // CPU number -> index in `node_tasks_` or -1
+  std::vector<int> cpu_nodes_;
+  // idle workers of work-stealing mode sleep here
+  Parker parker_;
+  std::vector<Worker> workers_;
 };
 
+namespace detail {
+
 /**
- * Post function for execution
- * @return nullopt of failure to add task to queue
+ * Callable of a task which resumes a suspended coroutine. Like `ResumeOnce`
+ * it owns the handle, but a task destroyed without running resumes
+ * the coroutine too, marking it `dropped`: the frame can't be destroyed
+ * instead as it may be owned by a `Lazy` which awaits it.
+ */
+class ResumeOrDrop {
+ public:
+  // lives in the awaitable, so in the suspended coroutine's frame
+  struct State {
+    // the task was rejected: the coroutine goes on without it
+    bool rejected{false};
+    // the task was destroyed without running
+    bool dropped{false};
+  };
+
+  ResumeOrDrop(std::coroutine_handle<> handle, State* state) noexcept
+      : handle_{handle}, state_{state} {}
+
+  ResumeOrDrop(ResumeOrDrop&& other) noexcept
+      : handle_{std::exchange(other.handle_, nullptr)}, state_{other.state_} {}
+
+  ResumeOrDrop& operator=(ResumeOrDrop&&) = delete;
+
+  ~ResumeOrDrop() {
+    if (handle_ && !state_->rejected) {
+      state_->dropped = true;
+      handle_.resume();
+    }
+  }
+
+  void operator()() { std::exchange(handle_, nullptr).resume(); }
+
+  // what `co_await` of the coroutine returns with
+  static void Check(const State& state) {
+    if (state.dropped) {
+      throw std::future_error{std::future_errc::broken_promise};
+    }
+  }
+
+ private:
+  std::coroutine_handle<> handle_;
+  State* state_;
+};
+
+}  // namespace detail
+
+/**
+ * Awaitable of `ThreadPool::Schedule`.
+ * The coroutine is resumed by a detached task which holds only its handle,
+ * so a suspension allocates nothing. If the pool rejects the task the
+ * coroutine goes on on the current thread.
+ * If the task is destroyed without running (discarded by the overflow policy
+ * or `Stop(StopMode::kDiscard)`, left in a destroyed pool) the coroutine is
+ * resumed by the thread which destroys it and `co_await` throws
+ * `std::future_error` with `broken_promise`.
+ */
+class ScheduleAwaitable {
+ public:
+  explicit ScheduleAwaitable(ThreadPool& executor) noexcept
+      : executor_{&executor} {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    auto task = Task::Detached(detail::ResumeOrDrop{handle, &state_});
+    // the coroutine may be running on a worker once `Post` returns
+    if (executor_->Post(std::move(task))) {
+      return true;
+    }
+    // the untouched task mustn't resume the coroutine going on here
+    state_.rejected = true;
+    return false;
+  }
+
+  void await_resume() const { detail::ResumeOrDrop::Check(state_); }
+
+ private:
+  ThreadPool* executor_;
+  detail::ResumeOrDrop::State state_;
+};
+
+inline ScheduleAwaitable ThreadPool::Schedule() noexcept {
+  return ScheduleAwaitable{*this};
+}
+
+/**
+ * Post function for execution honouring the pool's `OverflowPolicy`
+ * @return nullopt if the task was rejected
  * otherwise return optional future
  */
 template <traits::Bindable Func, traits::Bindable... Args,
@@ -104,4 +545,121 @@ template <traits::Bindable Func, class R = std::invoke_result_t<Func>>
   return std::make_optional(std::move(fut));
 }
 
+namespace detail {
+
+/**
+ * Callable which calls `f(token, args...)` (or `f(args...)` if `f` doesn't
+ * take a `std::stop_token`) unless stop was requested on `token` before,
+ * it throws `TaskCancelled` then.
+ */
+template <class Func, class... Args>
+auto WithStopToken(std::stop_token token, Func&& f, Args&&... args) {
+  return [token = std::move(token), func = std::forward<Func>(f),
+          ... params = std::forward<Args>(args)]() mutable -> decltype(auto) {
+    if (token.stop_requested()) {
+      throw TaskCancelled{"task cancelled"};
+    }
+    if constexpr (std::is_invocable_v<std::decay_t<Func>&, std::stop_token,
+                                      std::unwrap_reference_t<Args>...>) {
+      return std::invoke(func, token,
+                         std::unwrap_reference_t<Args>(params)...);
+    } else {
+      return std::invoke(func, std::unwrap_reference_t<Args>(params)...);
+    }
+  };
+}
+
+}  // namespace detail
+
+/**
+ * Post cancellable function: a task which didn't start before stop was
+ * requested on `token` is skipped and its future reports `TaskCancelled`,
+ * a running one sees the token if `f` takes it as the first argument.
+ * Tokens of a single `std::stop_source` cancel a group of tasks,
+ * the pool's own token (`GetStopToken`) is cancelled by `Stop`.
+ * @return nullopt if the task was rejected
+ */
+template <traits::Bindable Func, traits::Bindable... Args>
+[[nodiscard]] auto Post(ThreadPool& executor, std::stop_token token, Func&& f,
+                        Args&&... args) {
+  auto call = detail::WithStopToken(std::move(token), std::forward<Func>(f),
+                                    std::forward<Args>(args)...);
+  using R = std::invoke_result_t<decltype(call)&>;
+  Task task{std::move(call)};
+  std::optional<std::future<R>> fut{task.GetFuture<R>()};
+  if (!executor.Post(std::move(task))) {
+    fut.reset();
+  }
+  return fut;
+}
+
+// fire-and-forget version of the cancellable `Post`
+template <traits::Bindable Func, traits::Bindable... Args>
+[[nodiscard]] bool Dispatch(ThreadPool& executor, std::stop_token token,
+                            Func&& f, Args&&... args) {
+  return executor.Post(Task::Detached(detail::WithStopToken(
+      std::move(token), std::forward<Func>(f), std::forward<Args>(args)...)));
+}
+
+/**
+ * Post function for execution without any way to get its result:
+ * cheaper than `Post` as no future shared state is allocated.
+ * The task honours the pool's `OverflowPolicy`.
+ * @return false if the task was rejected
+ */
+template <traits::Bindable Func, traits::Bindable... Args>
+requires traits::Taskable<Func, Args...>
+[[nodiscard]] bool Dispatch(ThreadPool& executor, Func&& f, Args&&... args) {
+  return executor.Post(
+      Task::Detached(std::forward<Func>(f), std::forward<Args>(args)...));
+}
+
+/**
+ * `Post` to a priority lane, see `ThreadPool::Post(Task&&, Priority, ...)`
+ * @return nullopt if the task was rejected
+ */
+template <traits::Bindable Func, traits::Bindable... Args,
+          class R = std::invoke_result_t<Func, Args...>>
+requires traits::Taskable<Func, Args...>
+[[nodiscard]] std::optional<std::future<R>> Post(
+    ThreadPool& executor, Priority priority,
+    std::chrono::steady_clock::time_point deadline, Func&& f, Args&&... args) {
+  Task task{std::forward<Func>(f), std::forward<Args>(args)...};
+  auto fut = task.GetFuture<R>();
+  if (!executor.Post(std::move(task), priority, deadline)) {
+    return std::nullopt;
+  }
+  return std::make_optional(std::move(fut));
+}
+
+template <traits::Bindable Func, traits::Bindable... Args,
+          class R = std::invoke_result_t<Func, Args...>>
+requires traits::Taskable<Func, Args...>
+[[nodiscard]] std::optional<std::future<R>> Post(ThreadPool& executor,
+                                                 Priority priority, Func&& f,
+                                                 Args&&... args) {
+  return Post(executor, priority, std::chrono::steady_clock::time_point::max(),
+              std::forward<Func>(f), std::forward<Args>(args)...);
+}
+
+// @return false if the task was rejected
+template <traits::Bindable Func, traits::Bindable... Args>
+requires traits::Taskable<Func, Args...>
+[[nodiscard]] bool Dispatch(ThreadPool& executor, Priority priority,
+                            std::chrono::steady_clock::time_point deadline,
+                            Func&& f, Args&&... args) {
+  return executor.Post(
+      Task::Detached(std::forward<Func>(f), std::forward<Args>(args)...),
+      priority, deadline);
+}
+
+template <traits::Bindable Func, traits::Bindable... Args>
+requires traits::Taskable<Func, Args...>
+[[nodiscard]] bool Dispatch(ThreadPool& executor, Priority priority, Func&& f,
+                            Args&&... args) {
+  return Dispatch(executor, priority,
+                  std::chrono::steady_clock::time_point::max(),
+                  std::forward<Func>(f), std::forward<Args>(args)...);
+}
+
 }  // namespace klyaksa
@@ -2,8 +2,16 @@
 
 namespace klyaksa {
 
-TimedThreadPool::TimedThreadPool(size_t threads)
-    : ThreadPool{threads}, scheduler_{this}, stopped_{true} {}
+TimedThreadPool::TimedThreadPool(size_t threads, ThreadPoolOptions options,
+                                 SchedulerOptions scheduler_options)
+    : ThreadPool{threads, options},
+      scheduler_{this, scheduler_options},
+      stopped_{true} {}
+
+TimedThreadPool::~TimedThreadPool() {
+  scheduler_.Stop();
+  ThreadPool::Stop();
+}
 
 void TimedThreadPool::Start() {
   assert(stopped_.load(std::memory_order_acquire));
@@ -19,4 +27,11 @@ void TimedThreadPool::Stop() {
   stopped_.store(true, std::memory_order_release);
 }
 
+bool TimedThreadPool::Stop(StopMode mode, std::chrono::milliseconds timeout) {
+  scheduler_.Stop();
+  const bool drained = ThreadPool::Stop(mode, timeout);
+  stopped_.store(true, std::memory_order_release);
+  return drained;
+}
+
 }  // namespace klyaksa
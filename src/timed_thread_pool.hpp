@@ -1,13 +1,21 @@
 #pragma once
+#include <coroutine>
+
 #include "ccqueue.hpp"
 #include "scheduler.hpp"
 #include "thread_pool.hpp"
 
 namespace klyaksa {
 
+class SleepAwaitable;
+
 class TimedThreadPool : public ThreadPool {
  public:
-  TimedThreadPool(size_t threads);
+  TimedThreadPool(size_t threads, ThreadPoolOptions options = {},
+                  SchedulerOptions scheduler_options = {});
+
+  // workers are joined before the scheduler periodic timers re-arm through
+  ~TimedThreadPool() override;
 
   /**
    * Not atomic operation so:
@@ -24,16 +32,49 @@ class TimedThreadPool : public ThreadPool {
    */
   void Stop() override;
 
+  /**
+   * The scheduler stops first; pending timers (and expired ones staged
+   * for lack of room) stay with it and fire after the next `Start`,
+   * `mode` applies only to the pool's queued tasks.
+   * Unlike `Stop()` it may be called on a stopped pool, e.g. to discard
+   * the tasks `Stop()` left queued.
+   */
+  bool Stop(StopMode mode, std::chrono::milliseconds timeout =
+                               std::chrono::milliseconds::max()) override;
+
   bool IsStopped() const noexcept override {
     return scheduler_.IsStopped() && ThreadPool::IsStopped();
   }
 
-  void Post(Task&& task, Timeout delay) {
-    scheduler_.ScheduleAfter(delay, std::move(task));
+  /**
+   * @param slack how late the task may start, see `Scheduler::ScheduleAt`
+   * @return handle to cancel or reschedule the timer, see `Scheduler`
+   * Note: the pool's `OverflowPolicy` applies to an expired timer
+   * on the timer thread, one it rejects is staged
+   */
+  TimerHandle Post(Task&& task, Timeout delay,
+                   std::chrono::nanoseconds slack = {}) {
+    return scheduler_.ScheduleAfter(delay, std::move(task), slack);
   }
 
-  void Post(Task&& task, Timepoint when) {
-    scheduler_.ScheduleAt(when, std::move(task));
+  TimerHandle Post(Task&& task, Timepoint when,
+                   std::chrono::nanoseconds slack = {}) {
+    return scheduler_.ScheduleAt(when, std::move(task), slack);
+  }
+
+  /**
+   * `co_await executor.SleepFor(delay)` suspends the coroutine without
+   * blocking a thread: a timer resumes it on a worker
+   */
+  [[nodiscard]] SleepAwaitable SleepFor(
+      std::chrono::nanoseconds delay) noexcept;
+
+  [[nodiscard]] SleepAwaitable SleepUntil(Timepoint when) noexcept;
+
+  // see `Scheduler::ScheduleEvery`
+  PeriodicHandle PostEvery(Timeout period, SmallFunction fn,
+                           PeriodicMode mode = PeriodicMode::kFixedRate) {
+    return scheduler_.ScheduleEvery(period, std::move(fn), mode);
   }
 
  private:
@@ -42,6 +83,47 @@ class TimedThreadPool : public ThreadPool {
   std::atomic<bool> stopped_;
 };
 
+/**
+ * Awaitable of `TimedThreadPool::SleepFor` and `SleepUntil`: the timer's
+ * task holds only the coroutine handle and posts its resumption
+ * to the pool when it expires (see `ScheduleAwaitable`).
+ * If the task is destroyed without running (its timer is dropped by
+ * `LatePolicy` or left in a destroyed pool, the overflow policy discards it)
+ * the coroutine is resumed by the thread which destroys it and `co_await`
+ * throws `std::future_error` with `broken_promise`.
+ */
+class SleepAwaitable {
+ public:
+  SleepAwaitable(TimedThreadPool& executor, Timepoint when) noexcept
+      : executor_{&executor}, when_{when} {}
+
+  bool await_ready() const noexcept {
+    return when_ <= std::chrono::steady_clock::now();
+  }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    // the coroutine may be running once `Post` returns
+    (void)executor_->Post(
+        Task::Detached(detail::ResumeOrDrop{handle, &state_}), when_);
+  }
+
+  void await_resume() const { detail::ResumeOrDrop::Check(state_); }
+
+ private:
+  TimedThreadPool* executor_;
+  Timepoint when_;
+  detail::ResumeOrDrop::State state_;
+};
+
+inline SleepAwaitable TimedThreadPool::SleepFor(
+    std::chrono::nanoseconds delay) noexcept {
+  return SleepUntil(std::chrono::steady_clock::now() + delay);
+}
+
+inline SleepAwaitable TimedThreadPool::SleepUntil(Timepoint when) noexcept {
+  return SleepAwaitable{*this, when};
+}
+
 template <traits::Bindable Func>
 [[nodiscard]] auto Post(TimedThreadPool& timed_executor, Timeout delay,
                         Func&& f) {
@@ -84,4 +166,26 @@ requires traits::Taskable<Func, Args...>
   return fut;
 }
 
+/**
+ * fire-and-forget versions of `Post`, see `Dispatch(ThreadPool&, ...)`
+ * @return handle to cancel the timer (e.g. a timeout which is not needed)
+ */
+template <traits::Bindable Func, traits::Bindable... Args>
+requires traits::Taskable<Func, Args...>
+TimerHandle Dispatch(TimedThreadPool& timed_executor, Timeout delay, Func&& f,
+                     Args&&... args) {
+  return timed_executor.Post(
+      Task::Detached(std::forward<Func>(f), std::forward<Args>(args)...),
+      delay);
+}
+
+template <traits::Bindable Func, traits::Bindable... Args>
+requires traits::Taskable<Func, Args...>
+TimerHandle Dispatch(TimedThreadPool& timed_executor, Timepoint when,
+                     Func&& f, Args&&... args) {
+  return timed_executor.Post(
+      Task::Detached(std::forward<Func>(f), std::forward<Args>(args)...),
+      when);
+}
+
 }  // namespace klyaksa
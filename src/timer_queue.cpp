@@ -0,0 +1,405 @@
+#include "timer_queue.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+namespace klyaksa {
+
+Timepoint CoalesceDeadline(Timepoint deadline,
+                           std::chrono::nanoseconds slack) {
+  if (slack.count() <= 0) {
+    return deadline;
+  }
+  const auto earliest = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          deadline.time_since_epoch())
+          .count());
+  const auto latest = earliest + static_cast<std::uint64_t>(slack.count());
+  // drop the bits below the highest one that differs in the window bounds:
+  // `latest` has it set so the result is not less than `earliest`
+  const auto bit = std::bit_width(earliest ^ latest) - 1;
+  const auto coalesced = latest & ~((std::uint64_t{1} << bit) - 1);
+  return deadline + std::chrono::duration_cast<Timepoint::duration>(
+                        std::chrono::nanoseconds{
+                            static_cast<std::int64_t>(coalesced - earliest)});
+}
+
+std::unique_ptr<TimerQueue> MakeTimerQueue(TimerBackend backend,
+                                           std::chrono::nanoseconds tick) {
+  switch (backend) {
+    case TimerBackend::kMap:
+      return std::make_unique<MapTimerQueue>();
+    case TimerBackend::kWheel:
+      return std::make_unique<WheelTimerQueue>(tick);
+  }
+  throw std::invalid_argument("unknown timer backend");
+}
+
+TimerId MapTimerQueue::Insert(Timepoint deadline, Task&& task) {
+  Entry* entry = nullptr;
+  if (!spare_.empty()) {
+    entry = spare_.back();
+    spare_.pop_back();
+  } else {
+    entry = &entries_.emplace_back();
+  }
+  entry->task = std::move(task);
+  entry->position = timers_.emplace(deadline, entry);
+  return {entry, entry->generation};
+}
+
+std::optional<Task> MapTimerQueue::Cancel(TimerId id) {
+  Entry* entry = Find(id);
+  if (entry == nullptr) {
+    return std::nullopt;
+  }
+  timers_.erase(entry->position);
+  std::optional<Task> task{std::move(entry->task)};
+  Recycle(entry);
+  return task;
+}
+
+bool MapTimerQueue::Reschedule(TimerId id, Timepoint deadline) {
+  Entry* entry = Find(id);
+  if (entry == nullptr) {
+    return false;
+  }
+  auto node = timers_.extract(entry->position);
+  node.key() = deadline;
+  entry->position = timers_.insert(std::move(node));
+  return true;
+}
+
+void MapTimerQueue::PopExpired(Timepoint now,
+                               std::vector<ExpiredTimer>& expired) {
+  const auto right = timers_.upper_bound(now);
+  for (auto it = timers_.begin(); it != right; it++) {
+    expired.push_back({it->first, std::move(it->second->task)});
+    Recycle(it->second);
+  }
+  timers_.erase(timers_.begin(), right);
+}
+
+std::optional<Timepoint> MapTimerQueue::NextDeadline() const {
+  if (timers_.empty()) {
+    return std::nullopt;
+  }
+  return timers_.cbegin()->first;
+}
+
+MapTimerQueue::Entry* MapTimerQueue::Find(TimerId id) const noexcept {
+  auto* entry = static_cast<Entry*>(id.entry);
+  if (entry == nullptr || entry->generation != id.generation) {
+    return nullptr;
+  }
+  return entry;
+}
+
+void MapTimerQueue::Recycle(Entry* entry) noexcept {
+  entry->task = Task{};
+  entry->generation++;
+  spare_.push_back(entry);
+}
+
+void WheelTimerQueue::List::PushBack(Node* node) noexcept {
+  node->next = nullptr;
+  node->prev = tail;
+  if (tail != nullptr) {
+    tail->next = node;
+  } else {
+    head = node;
+  }
+  tail = node;
+}
+
+void WheelTimerQueue::List::Splice(List& other) noexcept {
+  if (other.Empty()) {
+    return;
+  }
+  if (Empty()) {
+    head = other.head;
+  } else {
+    tail->next = other.head;
+    other.head->prev = tail;
+  }
+  tail = other.tail;
+  other.head = other.tail = nullptr;
+}
+
+WheelTimerQueue::Node* WheelTimerQueue::List::PopFront() noexcept {
+  Node* node = head;
+  if (node != nullptr) {
+    head = node->next;
+    if (head != nullptr) {
+      head->prev = nullptr;
+    } else {
+      tail = nullptr;
+    }
+    node->next = nullptr;
+  }
+  return node;
+}
+
+void WheelTimerQueue::List::Erase(Node* node) noexcept {
+  if (node->prev != nullptr) {
+    node->prev->next = node->next;
+  } else {
+    head = node->next;
+  }
+  if (node->next != nullptr) {
+    node->next->prev = node->prev;
+  } else {
+    tail = node->prev;
+  }
+  node->prev = node->next = nullptr;
+}
+
+void WheelTimerQueue::Bitmap::Set(std::size_t index) noexcept {
+  words_[index / kWordBits] |= std::uint64_t{1} << (index % kWordBits);
+}
+
+void WheelTimerQueue::Bitmap::Reset(std::size_t index) noexcept {
+  words_[index / kWordBits] &= ~(std::uint64_t{1} << (index % kWordBits));
+}
+
+std::size_t WheelTimerQueue::Bitmap::FindNext(
+    std::size_t from) const noexcept {
+  for (std::size_t word = from / kWordBits; word < words_.size(); word++) {
+    auto bits = words_[word];
+    if (word == from / kWordBits) {
+      // drop bits below `from`
+      bits &= ~std::uint64_t{0} << (from % kWordBits);
+    }
+    if (bits != 0) {
+      return word * kWordBits +
+             static_cast<std::size_t>(std::countr_zero(bits));
+    }
+  }
+  return kSlots;
+}
+
+WheelTimerQueue::WheelTimerQueue(std::chrono::nanoseconds tick,
+                                 Timepoint origin)
+    : tick_{tick}, origin_{origin} {
+  if (tick_.count() <= 0) {
+    throw std::invalid_argument("timer wheel tick must be positive");
+  }
+}
+
+WheelTimerQueue::~WheelTimerQueue() {
+  for (auto&& level : slots_) {
+    for (auto&& slot : level) {
+      Release(slot);
+    }
+  }
+  Release(due_);
+  Release(spare_);
+}
+
+TimerId WheelTimerQueue::Insert(Timepoint deadline, Task&& task) {
+  Node* node = Acquire();
+  node->deadline = deadline;
+  node->expiry = TickAfter(deadline);
+  node->task = std::move(task);
+  Place(node);
+  size_++;
+  return {node, node->generation};
+}
+
+std::optional<Task> WheelTimerQueue::Cancel(TimerId id) {
+  Node* node = Find(id);
+  if (node == nullptr) {
+    return std::nullopt;
+  }
+  Unlink(node);
+  std::optional<Task> task{std::move(node->task)};
+  Recycle(node);
+  size_--;
+  return task;
+}
+
+bool WheelTimerQueue::Reschedule(TimerId id, Timepoint deadline) {
+  Node* node = Find(id);
+  if (node == nullptr) {
+    return false;
+  }
+  Unlink(node);
+  node->deadline = deadline;
+  node->expiry = TickAfter(deadline);
+  Place(node);
+  return true;
+}
+
+void WheelTimerQueue::PopExpired(Timepoint now,
+                                 std::vector<ExpiredTimer>& expired) {
+  if (now >= origin_) {
+    Advance(TickBefore(now));
+  }
+  const auto first = static_cast<std::ptrdiff_t>(expired.size());
+  while (Node* node = due_.PopFront()) {
+    expired.push_back({node->deadline, std::move(node->task)});
+    Recycle(node);
+    size_--;
+  }
+  // a slot holds the timers of a whole tick (or more for upper levels)
+  // in insertion order
+  std::stable_sort(expired.begin() + first, expired.end(),
+                   [](const ExpiredTimer& lhs, const ExpiredTimer& rhs) {
+                     return lhs.deadline < rhs.deadline;
+                   });
+}
+
+std::optional<Timepoint> WheelTimerQueue::NextDeadline() const {
+  if (!due_.Empty()) {
+    return due_.head->deadline;
+  }
+  if (scheduled_ == 0) {
+    return std::nullopt;
+  }
+  const auto index = static_cast<std::size_t>(current_ % kSlots);
+  if (index == 0) {
+    // upper levels cascade at the start of the turn
+    return TimeOf(current_);
+  }
+  const auto next = occupied_[0].FindNext(index);
+  // either the next busy slot of the lowest level
+  // or the end of its turn
+  return TimeOf(current_ + (next - index));
+}
+
+std::uint64_t WheelTimerQueue::TickAfter(Timepoint deadline) const noexcept {
+  if (deadline <= origin_) {
+    return 0;
+  }
+  const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      deadline - origin_);
+  return static_cast<std::uint64_t>((elapsed + tick_ - decltype(tick_){1}) /
+                                    tick_);
+}
+
+std::uint64_t WheelTimerQueue::TickBefore(Timepoint time) const noexcept {
+  const auto elapsed =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(time - origin_);
+  return static_cast<std::uint64_t>(elapsed / tick_);
+}
+
+Timepoint WheelTimerQueue::TimeOf(std::uint64_t tick) const noexcept {
+  return origin_ + std::chrono::duration_cast<Timepoint::duration>(
+                       tick_ * static_cast<std::int64_t>(tick));
+}
+
+WheelTimerQueue::Node* WheelTimerQueue::Find(TimerId id) const noexcept {
+  auto* node = static_cast<Node*>(id.entry);
+  if (node == nullptr || node->generation != id.generation) {
+    return nullptr;
+  }
+  return node;
+}
+
+void WheelTimerQueue::Place(Node* node) noexcept {
+  if (node->expiry < current_) {
+    node->level = kLevels;
+    due_.PushBack(node);
+    return;
+  }
+  auto expiry = node->expiry;
+  const auto distance = expiry - current_;
+  std::size_t level = 0;
+  while (level + 1 < kLevels && distance >> (kSlotBits * (level + 1)) != 0) {
+    level++;
+  }
+  static constexpr auto kReach = std::uint64_t{1} << (kSlotBits * kLevels);
+  if (distance >= kReach) {
+    // too far: wait for the top level to turn around
+    expiry = current_ + kReach - 1;
+  }
+  const auto index =
+      static_cast<std::size_t>((expiry >> (kSlotBits * level)) % kSlots);
+  node->level = level;
+  node->index = index;
+  slots_[level][index].PushBack(node);
+  occupied_[level].Set(index);
+  scheduled_++;
+}
+
+void WheelTimerQueue::Unlink(Node* node) noexcept {
+  if (node->level == kLevels) {
+    due_.Erase(node);
+    return;
+  }
+  auto& slot = slots_[node->level][node->index];
+  slot.Erase(node);
+  if (slot.Empty()) {
+    occupied_[node->level].Reset(node->index);
+  }
+  scheduled_--;
+}
+
+void WheelTimerQueue::Advance(std::uint64_t target) noexcept {
+  while (current_ <= target) {
+    if (scheduled_ == 0) {
+      current_ = target + 1;
+      return;
+    }
+    const auto index = static_cast<std::size_t>(current_ % kSlots);
+    if (index == 0) {
+      // the lowest level turned around: bring down timers of upper levels
+      for (std::size_t level = 1; level < kLevels; level++) {
+        const auto upper = static_cast<std::size_t>(
+            (current_ >> (kSlotBits * level)) % kSlots);
+        Cascade(level, upper);
+        if (upper != 0) {
+          break;
+        }
+      }
+    }
+    auto& slot = slots_[0][index];
+    if (!slot.Empty()) {
+      for (Node* node = slot.head; node != nullptr; node = node->next) {
+        node->level = kLevels;
+        scheduled_--;
+      }
+      due_.Splice(slot);
+      occupied_[0].Reset(index);
+    }
+    current_++;
+    // skip empty slots up to the end of the turn
+    const auto from = static_cast<std::size_t>(current_ % kSlots);
+    if (from != 0) {
+      const auto next = occupied_[0].FindNext(from);
+      current_ += std::min<std::uint64_t>(next - from, target + 1 - current_);
+    }
+  }
+}
+
+void WheelTimerQueue::Cascade(std::size_t level, std::size_t index) noexcept {
+  List slot{};
+  slot.Splice(slots_[level][index]);
+  occupied_[level].Reset(index);
+  while (Node* node = slot.PopFront()) {
+    scheduled_--;
+    Place(node);
+  }
+}
+
+WheelTimerQueue::Node* WheelTimerQueue::Acquire() {
+  if (Node* node = spare_.PopFront()) {
+    return node;
+  }
+  return new Node{};
+}
+
+void WheelTimerQueue::Recycle(Node* node) noexcept {
+  node->task = Task{};
+  node->generation++;
+  spare_.PushBack(node);
+}
+
+void WheelTimerQueue::Release(List& list) noexcept {
+  while (Node* node = list.PopFront()) {
+    delete node;
+  }
+}
+
+}  // namespace klyaksa
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "task.hpp"
+
+namespace klyaksa {
+
+using Timeout = std::chrono::milliseconds;
+using Timepoint = std::chrono::steady_clock::time_point;
+
+enum class TimerBackend {
+  // `std::multimap`: exact order, O(log n) insert with node allocation
+  kMap,
+  // hierarchical timing wheel: O(1) insert and expiry,
+  // deadlines are rounded up to the tick
+  kWheel,
+};
+
+struct ExpiredTimer {
+  Timepoint deadline;
+  Task task;
+};
+
+/**
+ * Time within `[deadline, deadline + slack]` with as many trailing zero
+ * bits (in nanoseconds of the clock) as possible: timers with overlapping
+ * windows tend to get the same time and fire together.
+ */
+[[nodiscard]] Timepoint CoalesceDeadline(Timepoint deadline,
+                                         std::chrono::nanoseconds slack);
+
+/**
+ * Identifies an inserted timer. Becomes stale once the timer is popped or
+ * cancelled: the queue reuses its entry under a new generation.
+ */
+struct TimerId {
+  void* entry{nullptr};
+  std::uint64_t generation{0};
+};
+
+/**
+ * Pending timers of `Scheduler`.
+ * Not thread-safe: the scheduler guards it by its mutex.
+ */
+class TimerQueue {
+ public:
+  virtual ~TimerQueue() = default;
+
+  virtual TimerId Insert(Timepoint deadline, Task&& task) = 0;
+
+  /**
+   * Remove a pending timer
+   * @return its task, nullopt if the timer is popped or cancelled already
+   */
+  virtual std::optional<Task> Cancel(TimerId id) = 0;
+
+  /**
+   * Move a pending timer to `deadline` reusing its entry
+   * @return false if the timer is popped or cancelled already
+   */
+  virtual bool Reschedule(TimerId id, Timepoint deadline) = 0;
+
+  // move timers due at `now` to the end of `expired` ordered by deadline
+  virtual void PopExpired(Timepoint now,
+                          std::vector<ExpiredTimer>& expired) = 0;
+
+  /**
+   * Time the timer thread should wake up at: deadline of the earliest timer
+   * (or earlier when the queue needs to reorganize itself).
+   * @return nullopt if there are no timers
+   */
+  [[nodiscard]] virtual std::optional<Timepoint> NextDeadline() const = 0;
+
+  [[nodiscard]] virtual std::size_t Size() const noexcept = 0;
+};
+
+/**
+ * @param tick resolution of `TimerBackend::kWheel`, ignored by others
+ */
+[[nodiscard]] std::unique_ptr<TimerQueue> MakeTimerQueue(
+    TimerBackend backend, std::chrono::nanoseconds tick);
+
+/**
+ * Entries are kept in a pool and point back to their map nodes
+ * so `Cancel` is O(1) and `Reschedule` moves the node without allocation.
+ */
+class MapTimerQueue final : public TimerQueue {
+ public:
+  TimerId Insert(Timepoint deadline, Task&& task) override;
+
+  std::optional<Task> Cancel(TimerId id) override;
+
+  bool Reschedule(TimerId id, Timepoint deadline) override;
+
+  void PopExpired(Timepoint now, std::vector<ExpiredTimer>& expired) override;
+
+  [[nodiscard]] std::optional<Timepoint> NextDeadline() const override;
+
+  [[nodiscard]] std::size_t Size() const noexcept override {
+    return timers_.size();
+  }
+
+ private:
+  struct Entry;
+  using Timers = std::multimap<Timepoint, Entry*>;
+
+  struct Entry {
+    Task task;
+    Timers::iterator position;
+    // bumped when the entry is released so old ids don't match
+    std::uint64_t generation{0};
+  };
+
+  // the pending entry of `id` or nullptr
+  [[nodiscard]] Entry* Find(TimerId id) const noexcept;
+  void Recycle(Entry* entry) noexcept;
+
+  Timers timers_;
+  // never shrinks: ids point into it
+  std::deque<Entry> entries_;
+  std::vector<Entry*> spare_;
+};
+
+/**
+ * Hierarchical timing wheel (see "Hashed and Hierarchical Timing Wheels",
+ * G. Varghese, T. Lauck).
+ *
+ * Time is split into ticks counted from `origin`. Level `l` has `kSlots`
+ * slots of `kSlots^l` ticks each, so a timer goes to the level matching
+ * its distance and moves (cascades) down as its time approaches.
+ * Timers farther than the top level can reach wait in the top level
+ * and are placed again once it turns around.
+ * Timers never fire early but may be up to a tick late.
+ * Nodes are recycled instead of being freed, a cancelled timer is unlinked
+ * from its slot in O(1).
+ */
+class WheelTimerQueue final : public TimerQueue {
+ public:
+  static constexpr std::size_t kLevels{4};
+  static constexpr std::size_t kSlotBits{8};
+  static constexpr std::size_t kSlots{1 << kSlotBits};
+
+  explicit WheelTimerQueue(
+      std::chrono::nanoseconds tick,
+      Timepoint origin = std::chrono::steady_clock::now());
+
+  WheelTimerQueue(const WheelTimerQueue&) = delete;
+  WheelTimerQueue& operator=(const WheelTimerQueue&) = delete;
+
+  ~WheelTimerQueue() override;
+
+  TimerId Insert(Timepoint deadline, Task&& task) override;
+
+  std::optional<Task> Cancel(TimerId id) override;
+
+  bool Reschedule(TimerId id, Timepoint deadline) override;
+
+  void PopExpired(Timepoint now, std::vector<ExpiredTimer>& expired) override;
+
+  [[nodiscard]] std::optional<Timepoint> NextDeadline() const override;
+
+  [[nodiscard]] std::size_t Size() const noexcept override { return size_; }
+
+ private:
+  struct Node {
+    Timepoint deadline{};
+    // the first tick the timer may fire at
+    std::uint64_t expiry{0};
+    Task task;
+    // slot the node is linked to, `kLevels` stands for `due_`
+    std::size_t level{kLevels};
+    std::size_t index{0};
+    // bumped when the node is recycled so old ids don't match
+    std::uint64_t generation{0};
+    Node* prev{nullptr};
+    Node* next{nullptr};
+  };
+
+  // intrusive doubly linked list of nodes
+  struct List {
+    void PushBack(Node* node) noexcept;
+    // append all nodes of `other` leaving it empty
+    void Splice(List& other) noexcept;
+    [[nodiscard]] Node* PopFront() noexcept;
+    void Erase(Node* node) noexcept;
+    [[nodiscard]] bool Empty() const noexcept { return head == nullptr; }
+
+    Node* head{nullptr};
+    Node* tail{nullptr};
+  };
+
+  // which slots of a level are not empty
+  class Bitmap {
+   public:
+    void Set(std::size_t index) noexcept;
+    void Reset(std::size_t index) noexcept;
+    // index of the first set bit not less than `from` or `kSlots`
+    [[nodiscard]] std::size_t FindNext(std::size_t from) const noexcept;
+
+   private:
+    static constexpr std::size_t kWordBits{64};
+    std::array<std::uint64_t, kSlots / kWordBits> words_{};
+  };
+
+  // the first tick at or after `deadline`
+  [[nodiscard]] std::uint64_t TickAfter(Timepoint deadline) const noexcept;
+  // the last tick at or before `time`
+  [[nodiscard]] std::uint64_t TickBefore(Timepoint time) const noexcept;
+  [[nodiscard]] Timepoint TimeOf(std::uint64_t tick) const noexcept;
+
+  // the pending node of `id` or nullptr
+  [[nodiscard]] Node* Find(TimerId id) const noexcept;
+  // put the node to the level and slot matching its distance from `current_`
+  void Place(Node* node) noexcept;
+  // take the node out of its slot or `due_`
+  void Unlink(Node* node) noexcept;
+  // process ticks up to `target` inclusive moving fired timers to `due_`
+  void Advance(std::uint64_t target) noexcept;
+  // move timers of the slot `index` of `level` down the levels
+  void Cascade(std::size_t level, std::size_t index) noexcept;
+
+  [[nodiscard]] Node* Acquire();
+  void Recycle(Node* node) noexcept;
+  static void Release(List& list) noexcept;
+
+  const std::chrono::nanoseconds tick_;
+  const Timepoint origin_;
+  // the next tick to process
+  std::uint64_t current_{0};
+  std::array<std::array<List, kSlots>, kLevels> slots_;
+  std::array<Bitmap, kLevels> occupied_;
+  // number of nodes in `slots_`
+  std::size_t scheduled_{0};
+  // fired but not popped yet
+  List due_;
+  // recycled nodes
+  List spare_;
+  std::size_t size_{0};
+};
+
+}  // namespace klyaksa
@@ -0,0 +1,225 @@
+#include "topology.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace klyaksa {
+
+namespace {
+
+const char* const kCpuRoot = "/sys/devices/system/cpu/cpu";
+const char* const kNodeRoot = "/sys/devices/system/node";
+
+int ReadInt(const std::string& path, int fallback) {
+  std::ifstream file{path};
+  int value = 0;
+  return file >> value ? value : fallback;
+}
+
+std::vector<int> AllowedCpus() {
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  if (cpus.empty()) {
+    const auto count = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned cpu = 0; cpu < count; cpu++) {
+      cpus.push_back(static_cast<int>(cpu));
+    }
+  }
+  return cpus;
+}
+
+// cpu -> node of every node listed in sysfs
+std::map<int, int> NodesOfCpus() {
+  std::map<int, int> nodes;
+  std::error_code error;
+  std::filesystem::directory_iterator it{kNodeRoot, error};
+  for (; !error && it != std::filesystem::directory_iterator{};
+       it.increment(error)) {
+    const auto name = it->path().filename().string();
+    int node = 0;
+    if (!name.starts_with("node") ||
+        std::from_chars(name.data() + 4, name.data() + name.size(), node).ec !=
+            std::errc{}) {
+      continue;
+    }
+    std::ifstream file{it->path() / "cpulist"};
+    std::string list;
+    std::getline(file, list);
+    for (int cpu : ParseCpuList(list)) {
+      nodes[cpu] = node;
+    }
+  }
+  return nodes;
+}
+
+CpuInfo InfoOf(const CpuTopology& topology, int cpu) {
+  auto it =
+      std::find_if(topology.cpus.begin(), topology.cpus.end(),
+                   [cpu](const CpuInfo& info) { return info.cpu == cpu; });
+  return it != topology.cpus.end() ? *it : CpuInfo{cpu, cpu, 0, 0};
+}
+
+// node by node, hyper-threads of a core last
+void Spread(std::vector<CpuInfo>& cpus) {
+  std::map<std::pair<int, int>, int> siblings;
+  std::map<int, std::vector<std::pair<int, CpuInfo>>> nodes;
+  for (auto&& info : cpus) {
+    const auto rank = siblings[{info.package, info.core}]++;
+    nodes[info.node].emplace_back(rank, info);
+  }
+  for (auto&& [node, ranked] : nodes) {
+    std::stable_sort(
+        ranked.begin(), ranked.end(),
+        [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+  }
+  const auto total = cpus.size();
+  cpus.clear();
+  for (std::size_t round = 0; cpus.size() < total; round++) {
+    for (auto&& [node, ranked] : nodes) {
+      if (round < ranked.size()) {
+        cpus.push_back(ranked[round].second);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+CpuTopology CpuTopology::Detect() {
+  CpuTopology topology;
+  const auto nodes = NodesOfCpus();
+  for (int cpu : AllowedCpus()) {
+    const auto prefix = kCpuRoot + std::to_string(cpu) + "/topology/";
+    auto node = nodes.find(cpu);
+    topology.cpus.push_back({
+        .cpu = cpu,
+        .core = ReadInt(prefix + "core_id", cpu),
+        .package = ReadInt(prefix + "physical_package_id", 0),
+        .node = node != nodes.end() ? node->second : 0,
+    });
+  }
+  return topology;
+}
+
+int CpuTopology::NodeOf(int cpu) const noexcept {
+  for (auto&& info : cpus) {
+    if (info.cpu == cpu) {
+      return info.node;
+    }
+  }
+  return -1;
+}
+
+std::vector<int> ParseCpuList(std::string_view list) {
+  std::vector<int> cpus;
+  while (!list.empty() && (list.back() == '\n' || list.back() == ' ')) {
+    list.remove_suffix(1);
+  }
+  const char* it = list.data();
+  const char* const end = list.data() + list.size();
+  while (it != end) {
+    int first = 0;
+    auto parsed = std::from_chars(it, end, first);
+    if (parsed.ec != std::errc{}) {
+      return {};
+    }
+    int last = first;
+    if (parsed.ptr != end && *parsed.ptr == '-') {
+      parsed = std::from_chars(parsed.ptr + 1, end, last);
+      if (parsed.ec != std::errc{} || last < first) {
+        return {};
+      }
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+    it = parsed.ptr;
+    if (it != end && *it++ != ',') {
+      return {};
+    }
+  }
+  return cpus;
+}
+
+std::vector<std::vector<int>> PlaceWorkers(const CpuTopology& topology,
+                                           WorkerPlacement placement,
+                                           std::span<const int> allowed,
+                                           std::size_t workers) {
+  if (placement == WorkerPlacement::kNone) {
+    return std::vector<std::vector<int>>(
+        workers, std::vector<int>(allowed.begin(), allowed.end()));
+  }
+  std::vector<CpuInfo> cpus;
+  if (allowed.empty()) {
+    cpus = topology.cpus;
+  } else {
+    cpus.reserve(allowed.size());
+    for (int cpu : allowed) {
+      cpus.push_back(InfoOf(topology, cpu));
+    }
+  }
+  if (cpus.empty()) {
+    return std::vector<std::vector<int>>(workers);
+  }
+  std::sort(cpus.begin(), cpus.end(), [](const auto& lhs, const auto& rhs) {
+    return std::tie(lhs.node, lhs.package, lhs.core, lhs.cpu) <
+           std::tie(rhs.node, rhs.package, rhs.core, rhs.cpu);
+  });
+  if (placement == WorkerPlacement::kSpread) {
+    Spread(cpus);
+  }
+  std::vector<std::vector<int>> placed;
+  placed.reserve(workers);
+  for (std::size_t i = 0; i < workers; i++) {
+    placed.push_back({cpus[i % cpus.size()].cpu});
+  }
+  return placed;
+}
+
+bool PinCurrentThread(std::span<const int> cpus) noexcept {
+  if (cpus.empty()) {
+    return true;
+  }
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+int CurrentCpu() noexcept {
+#ifdef __linux__
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+
+}  // namespace klyaksa
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace klyaksa {
+
+// How `ThreadPool` pins its workers to CPUs
+enum class WorkerPlacement {
+  // workers may run on any CPU of `ThreadPoolOptions::cpus`
+  kNone,
+  // a worker per CPU: NUMA nodes in turn and distinct cores
+  // before hyper-threads of the same core
+  kSpread,
+  // a worker per CPU: fill a core and then a node before the next one
+  kPack,
+};
+
+struct CpuInfo {
+  int cpu{0};
+  int core{0};
+  int package{0};
+  int node{0};
+};
+
+/**
+ * CPUs the process may run on (see `sched_getaffinity`) with their core,
+ * package and NUMA node read from `/sys/devices/system`.
+ * Missing topology files put every CPU on its own core of node 0.
+ */
+struct CpuTopology {
+  // ordered by CPU number
+  std::vector<CpuInfo> cpus;
+
+  [[nodiscard]] static CpuTopology Detect();
+
+  // node of the CPU or -1 if the CPU isn't known
+  [[nodiscard]] int NodeOf(int cpu) const noexcept;
+};
+
+/**
+ * Parse a Linux CPU list such as "0-3,8,10-11"
+ * @return CPU numbers in the list order, empty if the list is malformed
+ */
+[[nodiscard]] std::vector<int> ParseCpuList(std::string_view list);
+
+/**
+ * CPU set of every worker: a single CPU per worker for `kSpread` and
+ * `kPack` (CPUs are reused round-robin if there are more workers),
+ * the whole `allowed` set for `kNone`.
+ * @param allowed CPUs to use, every CPU of `topology` when empty
+ */
+[[nodiscard]] std::vector<std::vector<int>> PlaceWorkers(
+    const CpuTopology& topology, WorkerPlacement placement,
+    std::span<const int> allowed, std::size_t workers);
+
+/**
+ * Restrict the calling thread to `cpus`
+ * @return false if the platform doesn't support it or the call failed
+ */
+bool PinCurrentThread(std::span<const int> cpus) noexcept;
+
+// CPU the calling thread runs on or -1 if unknown
+[[nodiscard]] int CurrentCpu() noexcept;
+
+}  // namespace klyaksa
@@ -0,0 +1,96 @@
+// Chase-Lev work-stealing deque, see "Correct and Efficient Work-Stealing for
+// Weak Memory Models" (N. M. Le, A. Pop, A. Cohen, F. Zappa Nardelli)
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Bounded work-stealing deque of pointers.
+ *
+ * The owner thread pushes and pops at the bottom (LIFO) without contention,
+ * any other thread may steal from the top (FIFO).
+ * Fences of the original algorithm are replaced by seq_cst operations
+ * because TSan doesn't support standalone fences.
+ */
+template <typename T, std::size_t Capacity>
+class WsDeque {
+ public:
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+  static constexpr std::size_t kCapacity{Capacity};
+
+  using element = T*;
+
+  // owner only: return false if the deque is full
+  [[nodiscard]] bool Push(element value) noexcept {
+    const auto b = bottom_.load(std::memory_order_relaxed);
+    const auto t = top_.load(std::memory_order_acquire);
+    if (b - t >= static_cast<std::int64_t>(kCapacity)) {
+      return false;
+    }
+    buffer_[b & kMask].store(value, std::memory_order_relaxed);
+    // publish the slot; seq_cst so the owner can check for sleeping thieves
+    // right after the push without a fence
+    bottom_.store(b + 1, std::memory_order_seq_cst);
+    return true;
+  }
+
+  // owner only: return the most recently pushed element or nullptr
+  [[nodiscard]] element Pop() noexcept {
+    const auto b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_seq_cst);
+    auto t = top_.load(std::memory_order_seq_cst);
+    if (t > b) {
+      // empty
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    element value = buffer_[b & kMask].load(std::memory_order_relaxed);
+    if (t == b) {
+      // the last element: race against thieves
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        value = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return value;
+  }
+
+  // any thread: return the oldest element or nullptr if the deque is empty
+  [[nodiscard]] element Steal() noexcept {
+    for (;;) {
+      auto t = top_.load(std::memory_order_seq_cst);
+      const auto b = bottom_.load(std::memory_order_seq_cst);
+      if (t >= b) {
+        return nullptr;
+      }
+      element value = buffer_[t & kMask].load(std::memory_order_relaxed);
+      if (top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+        return value;
+      }
+      // lost the race to another thief or the owner: try again
+    }
+  }
+
+  // approximate number of elements
+  [[nodiscard]] std::size_t Size() const noexcept {
+    const auto b = bottom_.load(std::memory_order_relaxed);
+    const auto t = top_.load(std::memory_order_relaxed);
+    return b > t ? static_cast<std::size_t>(b - t) : 0;
+  }
+
+ private:
+  static constexpr std::int64_t kMask{static_cast<std::int64_t>(kCapacity) -
+                                      1};
+  static constexpr std::size_t kCacheLine{64};
+
+  alignas(kCacheLine) std::atomic<std::int64_t> top_{0};
+  alignas(kCacheLine) std::atomic<std::int64_t> bottom_{0};
+  alignas(kCacheLine) std::array<std::atomic<element>, kCapacity> buffer_{};
+};
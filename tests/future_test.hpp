@@ -0,0 +1,98 @@
+#pragma once
+
+#include "future.hpp"
+#include "gtest/gtest.h"
+#include "thread_pool.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(future, promise_sets_value) {
+  klyaksa::Promise<int> promise;
+  auto future = promise.GetFuture();
+  ASSERT_THROW((void)promise.GetFuture(), std::future_error);
+  ASSERT_FALSE(future.IsReady());
+  std::jthread producer{[&promise]() { promise.SetValue(7); }};
+  ASSERT_EQ(future.Get(), 7);
+  ASSERT_FALSE(future.Valid());
+  ASSERT_THROW(promise.SetValue(8), std::future_error);
+}
+
+TEST(future, broken_promise) {
+  klyaksa::Future<void> future;
+  {
+    klyaksa::Promise<void> promise;
+    future = promise.GetFuture();
+  }
+  ASSERT_TRUE(future.IsReady());
+  ASSERT_THROW(future.Get(), std::future_error);
+}
+
+TEST(future, then_chains_stages) {
+  klyaksa::ThreadPool executor{2};
+  executor.Start();
+  auto first = Async(executor, [](int x) { return x * 2; }, 21);
+  ASSERT_TRUE(first);
+  auto last = std::move(*first)
+                  .Then(executor, [](int x) { return std::to_string(x); })
+                  .Then(executor, [](std::string s) { return s + "!"; });
+  ASSERT_EQ(last.Get(), "42!");
+
+  // continuation of the ready future
+  klyaksa::Promise<void> promise;
+  auto ready = promise.GetFuture();
+  promise.SetValue();
+  ASSERT_EQ(std::move(ready).Then(executor, [] { return 1; }).Get(), 1);
+  executor.Stop();
+}
+
+TEST(future, then_forwards_exception) {
+  klyaksa::ThreadPool executor{2};
+  executor.Start();
+  auto failed = Async(executor, []() -> int { throw std::runtime_error("x"); });
+  ASSERT_TRUE(failed);
+  std::atomic<bool> called{false};
+  auto next = std::move(*failed).Then(executor, [&called](int x) {
+    called = true;
+    return x;
+  });
+  ASSERT_THROW(next.Get(), std::runtime_error);
+  ASSERT_FALSE(called);
+  executor.Stop();
+}
+
+TEST(future, when_all) {
+  klyaksa::ThreadPool executor{3};
+  executor.Start();
+  std::vector<klyaksa::Future<int>> futures;
+  for (int i = 0; i < 10; i++) {
+    futures.push_back(*Async(executor, [i] { return i * i; }));
+  }
+  auto all = WhenAll(std::move(futures)).Then(executor, [](auto values) {
+    int sum = 0;
+    for (int value : values) {
+      sum += value;
+    }
+    return sum;
+  });
+  ASSERT_EQ(all.Get(), 285);
+  ASSERT_NO_THROW(WhenAll(std::vector<klyaksa::Future<void>>{}).Get());
+  executor.Stop();
+}
+
+TEST(future, when_any) {
+  klyaksa::Promise<int> slow;
+  klyaksa::Promise<int> fast;
+  std::vector<klyaksa::Future<int>> futures;
+  futures.push_back(slow.GetFuture());
+  futures.push_back(fast.GetFuture());
+  auto any = WhenAny(std::move(futures));
+  ASSERT_FALSE(any.IsReady());
+  fast.SetValue(2);
+  slow.SetValue(1);
+  auto [index, value] = any.Get();
+  ASSERT_EQ(index, 1u);
+  ASSERT_EQ(value, 2);
+}
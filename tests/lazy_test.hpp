@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "lazy.hpp"
+#include "timed_thread_pool.hpp"
+
+namespace {
+
+klyaksa::Lazy<std::thread::id> WorkerId(klyaksa::ThreadPool& executor) {
+  co_await executor.Schedule();
+  co_return std::this_thread::get_id();
+}
+
+klyaksa::Lazy<int> Square(int value) {
+  if (value < 0) {
+    throw std::invalid_argument("negative");
+  }
+  co_return value * value;
+}
+
+klyaksa::Lazy<int> SumOfSquares(klyaksa::ThreadPool& executor, int n) {
+  int sum = 0;
+  for (int i = 1; i <= n; i++) {
+    co_await executor.Schedule();
+    sum += co_await Square(i);
+  }
+  co_return sum;
+}
+
+klyaksa::Lazy<> Sleep(klyaksa::TimedThreadPool& executor,
+                      std::chrono::milliseconds delay) {
+  co_await executor.SleepFor(delay);
+}
+
+}  // namespace
+
+TEST(lazy, schedule_on_pool) {
+  klyaksa::ThreadPool executor{2};
+  executor.Start();
+  auto id = Post(executor, WorkerId(executor));
+  ASSERT_TRUE(id);
+  ASSERT_NE(id->get(), std::this_thread::get_id());
+
+  auto sum = Post(executor, SumOfSquares(executor, 10));
+  ASSERT_TRUE(sum);
+  ASSERT_EQ(sum->get(), 385);
+
+  auto error = Post(executor, Square(-1));
+  ASSERT_TRUE(error);
+  ASSERT_THROW(error->get(), std::invalid_argument);
+  executor.Stop();
+}
+
+TEST(lazy, rejected_coroutine_is_destroyed) {
+  klyaksa::ThreadPool executor{1, {.queue_capacity = 2}};
+  // the lock-free queue may round the capacity up
+  while (Dispatch(executor, [] {})) {
+  }
+  auto token = std::make_shared<int>(0);
+  auto lazy = [](std::shared_ptr<int> token) -> klyaksa::Lazy<int> {
+    co_return *token;
+  };
+  ASSERT_FALSE(Post(executor, lazy(token)));
+  ASSERT_EQ(token.use_count(), 1);
+}
+
+TEST(lazy, sleep_without_blocking) {
+  using namespace std::chrono_literals;
+  klyaksa::TimedThreadPool executor{1};
+  executor.Start();
+  // a single worker: sleeps overlap as nobody blocks it
+  static constexpr int kSleepers{20};
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::future<void>> results;
+  for (int i = 0; i < kSleepers; i++) {
+    auto fut = Post(executor, Sleep(executor, 50ms));
+    ASSERT_TRUE(fut);
+    results.push_back(std::move(*fut));
+  }
+  for (auto&& result : results) {
+    result.get();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  ASSERT_GE(elapsed, 50ms);
+  ASSERT_LT(elapsed, 50ms * kSleepers / 2);
+  executor.Stop();
+}
+
+TEST(lazy, discarded_schedule_resumes_with_error) {
+  klyaksa::ThreadPool executor{1};
+  klyaksa::ThreadPool stopped{1};
+  executor.Start();
+  // the coroutine hops to a pool which never runs it
+  auto id = Post(executor, WorkerId(stopped));
+  ASSERT_TRUE(id);
+  while (stopped.Snapshot().queue_size == 0) {
+    std::this_thread::yield();
+  }
+  ASSERT_TRUE(stopped.Stop(klyaksa::StopMode::kDiscard));
+  ASSERT_THROW(id->get(), std::future_error);
+  executor.Stop();
+}
+
+TEST(lazy, evicted_sleep_resumes_with_error) {
+  using namespace std::chrono_literals;
+  klyaksa::ThreadPool executor{1};
+  klyaksa::TimedThreadPool timed{
+      1,
+      {.queue_capacity = 2,
+       .overflow_policy = klyaksa::OverflowPolicy::kDiscardOldest}};
+  executor.Start();
+  timed.Start();
+  std::promise<void> release;
+  std::atomic<bool> blocked{false};
+  ASSERT_TRUE(Dispatch(timed, [gate = release.get_future(), &blocked] {
+    blocked = true;
+    gate.wait();
+  }));
+  while (!blocked) {
+    std::this_thread::yield();
+  }
+  auto slept = Post(executor, Sleep(timed, 1ms));
+  ASSERT_TRUE(slept);
+  // the timer has expired and its task waits for the blocked worker
+  while (timed.Snapshot().queue_size == 0) {
+    std::this_thread::yield();
+  }
+  // newer tasks evict it
+  for (std::size_t i = 0; i < timed.QueueCapacity(); i++) {
+    ASSERT_TRUE(Dispatch(timed, [] {}));
+  }
+  ASSERT_THROW(slept->get(), std::future_error);
+  release.set_value();
+  timed.Stop();
+  executor.Stop();
+}
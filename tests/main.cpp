@@ -1,7 +1,15 @@
+#include "future_test.hpp"
 #include "gtest/gtest.h"
+#include "lazy_test.hpp"
+#include "parallel_test.hpp"
+#include "queue_test.hpp"
 #include "scheduler_test.hpp"
+#include "task_graph_test.hpp"
+#include "task_group_test.hpp"
 #include "thread_pool_test.hpp"
 #include "timed_thread_pool_test.hpp"
+#include "timer_queue_test.hpp"
+#include "topology_test.hpp"
 
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
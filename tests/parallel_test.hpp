@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "parallel.hpp"
+
+TEST(parallel, parallel_for) {
+  for (bool work_stealing : {false, true}) {
+    klyaksa::ThreadPool executor{3, {.work_stealing = work_stealing}};
+    executor.Start();
+    static constexpr std::size_t kSize{100'000};
+    std::vector<int> hits(kSize, 0);
+    klyaksa::ParallelFor(executor, 0, kSize, [&hits](int i) { hits[i]++; });
+    ASSERT_TRUE(std::all_of(hits.begin(), hits.end(),
+                            [](int hit) { return hit == 1; }));
+    // range version with an explicit grain
+    klyaksa::ParallelFor(
+        executor, hits, [](int& hit) { hit *= 3; }, 1000);
+    ASSERT_EQ(std::accumulate(hits.begin(), hits.end(), std::size_t{0}),
+              3 * kSize);
+    // empty ranges
+    klyaksa::ParallelFor(executor, 5, 5, [](int) { FAIL(); });
+    klyaksa::ParallelFor(executor, std::vector<int>{}, [](int) { FAIL(); });
+    executor.Stop();
+  }
+}
+
+TEST(parallel, reduce_and_transform) {
+  klyaksa::ThreadPool executor{4};
+  executor.Start();
+  std::vector<std::uint64_t> values(50'000);
+  std::iota(values.begin(), values.end(), std::uint64_t{1});
+  const auto sum = klyaksa::ParallelReduce(executor, values, std::uint64_t{7},
+                                           std::plus<>{});
+  ASSERT_EQ(sum, 7 + values.size() * (values.size() + 1) / 2);
+  ASSERT_EQ(klyaksa::ParallelReduce(executor, std::vector<int>{}, 42,
+                                    std::plus<>{}),
+            42);
+
+  std::vector<std::uint64_t> squares(values.size());
+  auto end = klyaksa::ParallelTransform(
+      executor, values, squares.begin(),
+      [](std::uint64_t value) { return value * value; });
+  ASSERT_EQ(end, squares.end());
+  for (std::size_t i = 0; i < values.size(); i++) {
+    ASSERT_EQ(squares[i], values[i] * values[i]);
+  }
+  executor.Stop();
+}
+
+TEST(parallel, survives_full_queue) {
+  // a tiny queue which is already full: the caller does the work itself
+  klyaksa::ThreadPool executor{2, {.queue_capacity = 2}};
+  std::atomic<bool> release{false};
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(Dispatch(executor, [&release] { release.wait(false); }));
+  }
+  std::atomic<std::size_t> calls{0};
+  klyaksa::ParallelFor(
+      executor, 0, 10'000,
+      [&calls](int) { calls.fetch_add(1, std::memory_order_relaxed); }, 1);
+  ASSERT_EQ(calls.load(), 10'000u);
+  executor.Start();
+  release.store(true);
+  release.notify_all();
+  executor.Stop();
+}
+
+TEST(parallel, exception_and_nesting) {
+  klyaksa::ThreadPool executor{2, {.work_stealing = true}};
+  executor.Start();
+  ASSERT_THROW(klyaksa::ParallelFor(executor, 0, 1000,
+                                    [](int i) {
+                                      if (i == 500) {
+                                        throw std::runtime_error("500");
+                                      }
+                                    }),
+               std::runtime_error);
+  // a worker running a parallel loop takes part in it as the caller
+  std::atomic<int> inner{0};
+  klyaksa::ParallelFor(executor, 0, 8, [&](int) {
+    klyaksa::ParallelFor(executor, 0, 100, [&inner](int) {
+      inner.fetch_add(1, std::memory_order_relaxed);
+    });
+  });
+  ASSERT_EQ(inner.load(), 800);
+  executor.Stop();
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "ccqueue.hpp"
+#include "gtest/gtest.h"
+#include "lfqueue.hpp"
+
+#include <atomic>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+template <class Queue>
+class queue : public ::testing::Test {
+ protected:
+  static constexpr std::size_t kCapacity{8};
+};
+
+using QueueTypes = ::testing::Types<CcQueue<int>, LfQueue<int>>;
+TYPED_TEST_SUITE(queue, QueueTypes);
+
+TYPED_TEST(queue, push_until_full) {
+  TypeParam queue{this->kCapacity};
+  queue.Resume();
+  for (int i = 0; i < static_cast<int>(this->kCapacity); i++) {
+    ASSERT_TRUE(queue.TryPush(i));
+  }
+  ASSERT_FALSE(queue.TryPush(-1)) << "queue must be full";
+
+  for (int i = 0; i < static_cast<int>(this->kCapacity); i++) {
+    auto value = queue.TryPop();
+    ASSERT_TRUE(value.has_value());
+    ASSERT_EQ(*value, i) << "queue must preserve FIFO order";
+  }
+  ASSERT_TRUE(queue.TryPush(42)) << "popped slots must be reusable";
+  ASSERT_EQ(queue.Pop(), 42);
+}
+
+TYPED_TEST(queue, halt_releases_consumers) {
+  TypeParam queue{this->kCapacity};
+  queue.Resume();
+  std::atomic<int> released{0};
+  std::vector<std::jthread> consumers;
+  for (int i = 0; i < 4; i++) {
+    consumers.emplace_back([&]() {
+      while (queue.TryPop()) {
+      }
+      released++;
+    });
+  }
+  ASSERT_TRUE(queue.TryPush(1));
+  queue.Halt();
+  consumers.clear();
+  ASSERT_EQ(released, 4);
+  // halted and empty queue doesn't block
+  ASSERT_FALSE(queue.TryPop().has_value());
+}
+
+TYPED_TEST(queue, concurrent_producers_and_consumers) {
+  static constexpr int kProducers{4};
+  static constexpr int kItems{10'000};
+
+  TypeParam queue{this->kCapacity};
+  queue.Resume();
+  std::atomic<long long> sum{0};
+  std::vector<std::jthread> consumers;
+  for (int i = 0; i < 2; i++) {
+    consumers.emplace_back([&]() {
+      while (auto value = queue.TryPop()) {
+        sum += *value;
+      }
+    });
+  }
+  {
+    std::vector<std::jthread> producers;
+    for (int i = 0; i < kProducers; i++) {
+      producers.emplace_back([&]() {
+        for (int j = 1; j <= kItems; j++) {
+          while (!queue.TryPush(j)) {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+  }
+  queue.Halt();
+  consumers.clear();
+  ASSERT_EQ(sum, 1LL * kProducers * kItems * (kItems + 1) / 2);
+}
+
+TYPED_TEST(queue, push_for_waits_for_free_slot) {
+  using namespace std::chrono_literals;
+  TypeParam queue{this->kCapacity};
+  queue.Resume();
+  for (int i = 0; i < static_cast<int>(this->kCapacity); i++) {
+    ASSERT_TRUE(queue.TryPush(i));
+  }
+  ASSERT_FALSE(queue.TryPushFor(-1, 10ms)) << "nobody pops: timeout";
+
+  std::jthread consumer{[&]() {
+    std::this_thread::sleep_for(10ms);
+    (void)queue.TryPop();
+  }};
+  ASSERT_TRUE(queue.TryPushFor(-1, 10s));
+}
+
+TYPED_TEST(queue, push_evict_oldest) {
+  TypeParam queue{this->kCapacity};
+  queue.Resume();
+  ASSERT_FALSE(queue.PushEvictOldest(0).has_value());
+  for (int i = 1; i < static_cast<int>(this->kCapacity); i++) {
+    ASSERT_TRUE(queue.TryPush(i));
+  }
+  auto evicted = queue.PushEvictOldest(100);
+  ASSERT_TRUE(evicted.has_value());
+  ASSERT_EQ(*evicted, 0);
+  ASSERT_EQ(queue.Poll(), std::optional<int>{1});
+}
+
+TYPED_TEST(queue, unused_wakes_dont_pile_up) {
+  TypeParam queue{this->kCapacity};
+  queue.Resume();
+  for (int i = 0; i < 10; i++) {
+    queue.Wake();
+  }
+  // nobody was blocked: a single call is kept for the next consumer
+  ASSERT_FALSE(queue.TryPop().has_value());
+  std::atomic<bool> popped{false};
+  std::jthread consumer{[&]() {
+    ASSERT_EQ(queue.TryPop(), 7);
+    popped = true;
+  }};
+  std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  const bool returned_early = popped;
+  ASSERT_TRUE(queue.TryPush(7));
+  consumer.join();
+  ASSERT_FALSE(returned_early) << "the consumer must block on the empty queue";
+}
+
+TYPED_TEST(queue, runtime_capacity) {
+  TypeParam queue{3};
+  queue.Resume();
+  ASSERT_EQ(queue.Capacity(), 3u);
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(queue.TryPush(i));
+  }
+  ASSERT_FALSE(queue.TryPush(3));
+  ASSERT_THROW(TypeParam{0}, std::invalid_argument);
+}
+
+TEST(queue, unbounded_recycles_segments) {
+  using Queue = CcQueue<int>;
+  static constexpr int kItems{static_cast<int>(10 * Queue::kSegmentSize) + 3};
+  Queue queue{Queue::kUnbounded};
+  queue.Resume();
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < kItems; i++) {
+      ASSERT_TRUE(queue.TryPush(i));
+    }
+    for (int i = 0; i < kItems; i++) {
+      ASSERT_EQ(queue.Poll(), std::optional<int>{i});
+    }
+    ASSERT_FALSE(queue.Poll().has_value());
+  }
+}
+
+TEST(queue, lock_free_rejects_unbounded) {
+  using Queue = LfQueue<int>;
+  ASSERT_THROW(Queue{Queue::kUnbounded}, std::invalid_argument);
+}
+
+TYPED_TEST(queue, push_n_moves_what_fits) {
+  TypeParam queue{this->kCapacity};
+  queue.Resume();
+  ASSERT_TRUE(queue.TryPush(0));
+  std::vector<int> values(this->kCapacity + 2);
+  std::iota(values.begin(), values.end(), 1);
+  ASSERT_EQ(queue.TryPushN(values), this->kCapacity - 1);
+  for (int i = 0; i < static_cast<int>(this->kCapacity); i++) {
+    ASSERT_EQ(queue.Poll(), std::optional<int>{i});
+  }
+  ASSERT_EQ(queue.TryPushN(std::span{values}.last(3)), 3u)
+      << "leftover must be untouched";
+  ASSERT_EQ(queue.Poll(), std::optional<int>{this->kCapacity});
+}
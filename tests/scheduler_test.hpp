@@ -86,6 +86,44 @@ TEST(scheduler, schedule_at_expired_time) {
   ASSERT_EQ(scheduler.CallbackCount(), 0);
 }
 
+TEST(scheduler, schedule_at_expired_time_stages_rejected_task) {
+  using namespace std::chrono_literals;
+  static constexpr std::size_t kCapacity{4};
+  klyaksa::ThreadPool pool{1, {.queue_capacity = kCapacity}};
+  klyaksa::Scheduler scheduler{&pool};
+  pool.Start();
+  scheduler.Start();
+  std::atomic<bool> release{false};
+  std::atomic<bool> running{false};
+  ASSERT_TRUE(Dispatch(pool, [&release, &running]() {
+    running = true;
+    while (!release) {
+      std::this_thread::sleep_for(1ms);
+    }
+  }));
+  while (!running) {
+    std::this_thread::yield();
+  }
+  for (std::size_t i = 0; i < pool.QueueCapacity(); i++) {
+    ASSERT_TRUE(Dispatch(pool, []() {}));
+  }
+  klyaksa::Task task{[]() {}};
+  auto done = task.GetFuture<void>();
+  scheduler.ScheduleAt(std::chrono::steady_clock::now() - 1ms,
+                       std::move(task));
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (scheduler.Stats().staging_size == 0 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  ASSERT_EQ(scheduler.Stats().staging_size, 1u);
+  release = true;
+  ASSERT_EQ(done.wait_for(10s), std::future_status::ready);
+  done.get();
+  scheduler.Stop();
+  pool.Stop();
+}
+
 TEST(scheduler, schedule_at_current_time) {
   using namespace std::chrono_literals;
 
@@ -260,3 +298,381 @@ TEST(scheduler, correct_schedule_mix_sequence) {
   EXPECT_EQ(sequence.size(), kInsertElements);
   EXPECT_TRUE(std::ranges::is_sorted(sequence));
 }
+
+TEST(scheduler, many_timers_expire_at_once) {
+  using namespace std::chrono_literals;
+  static constexpr int kTimers{100};
+
+  // the queue is smaller than the batch: the rest is submitted later
+  klyaksa::ThreadPool pool{2, {.queue_capacity = 8}};
+  klyaksa::Scheduler scheduler{&pool};
+  std::atomic<int> counter{0};
+  const auto when = std::chrono::steady_clock::now() + 20ms;
+  for (int i = 0; i < kTimers; i++) {
+    scheduler.ScheduleAt(when, [&counter]() { counter++; });
+  }
+  pool.Start();
+  scheduler.Start();
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (counter < kTimers && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  scheduler.Stop();
+  pool.Stop();
+  ASSERT_EQ(counter, kTimers);
+  ASSERT_EQ(scheduler.CallbackCount(), 0);
+}
+
+TEST(scheduler, cancel_and_reschedule_timers) {
+  using namespace std::chrono_literals;
+
+  klyaksa::ThreadPool pool{2};
+  klyaksa::Scheduler scheduler{&pool};
+  pool.Start();
+  scheduler.Start();
+  std::atomic<int> fired{0};
+  // a timeout which isn't needed anymore
+  auto timeout = scheduler.ScheduleAfter(20ms, [&fired]() { fired += 1; });
+  auto late = scheduler.ScheduleAfter(20ms, [&fired]() { fired += 10; });
+  ASSERT_EQ(scheduler.CallbackCount(), 2);
+  ASSERT_TRUE(timeout.Cancel());
+  ASSERT_FALSE(timeout.Cancel());
+  ASSERT_EQ(scheduler.CallbackCount(), 1);
+  ASSERT_TRUE(late.Reschedule(std::chrono::steady_clock::now() + 60ms));
+
+  std::this_thread::sleep_for(40ms);
+  ASSERT_EQ(fired, 0);
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (fired == 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  ASSERT_EQ(fired, 10);
+  // already submitted
+  ASSERT_FALSE(late.Cancel());
+  ASSERT_FALSE(late.Reschedule(std::chrono::steady_clock::now() + 1s));
+  ASSERT_FALSE(klyaksa::TimerHandle{}.Cancel());
+  scheduler.Stop();
+  pool.Stop();
+}
+
+TEST(scheduler, periodic_timers) {
+  using namespace std::chrono_literals;
+
+  klyaksa::ThreadPool pool{2};
+  klyaksa::Scheduler scheduler{&pool};
+  pool.Start();
+  scheduler.Start();
+  std::atomic<int> rate{0};
+  std::atomic<int> delay{0};
+  std::atomic<int> skip{0};
+  const auto start = std::chrono::steady_clock::now();
+  auto by_rate = scheduler.ScheduleEvery(5ms, [&rate]() { rate++; });
+  auto by_delay = scheduler.ScheduleEvery(
+      5ms,
+      [&delay]() {
+        delay++;
+        std::this_thread::sleep_for(5ms);
+      },
+      klyaksa::PeriodicMode::kFixedDelay);
+  // throwing doesn't stop the timer
+  auto skipping = scheduler.ScheduleEvery(
+      5ms,
+      [&skip]() {
+        skip++;
+        throw std::runtime_error("ignored");
+      },
+      klyaksa::PeriodicMode::kFixedRateSkip);
+
+  const auto deadline = start + 10s;
+  while ((rate < 10 || delay < 5 || skip < 5) &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  ASSERT_TRUE(by_rate.Cancel());
+  ASSERT_TRUE(by_delay.Cancel());
+  ASSERT_TRUE(skipping.Cancel());
+  ASSERT_FALSE(by_rate.Cancel());
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  // fixed rate never runs ahead of the schedule
+  ASSERT_LE(rate, elapsed / 5ms);
+  // a run of fixed delay takes 5ms plus the period
+  ASSERT_LE(delay, elapsed / 10ms + 1);
+  ASSERT_GE(skip, 5);
+
+  std::this_thread::sleep_for(20ms);
+  const int stopped = rate;
+  std::this_thread::sleep_for(20ms);
+  ASSERT_EQ(rate, stopped);
+  ASSERT_EQ(scheduler.CallbackCount(), 0);
+  scheduler.Stop();
+  pool.Stop();
+}
+
+TEST(scheduler, precision_mode_wakes_for_earlier_deadline) {
+  using namespace std::chrono_literals;
+
+  klyaksa::ThreadPool pool{1};
+  klyaksa::Scheduler scheduler{&pool, {.spin_threshold = 500us}};
+  pool.Start();
+  scheduler.Start();
+  std::atomic<bool> fired{false};
+  // the timer thread goes to sleep for a second
+  auto far = scheduler.ScheduleAfter(1s, []() {});
+  std::this_thread::sleep_for(5ms);
+  const auto deadline = std::chrono::steady_clock::now() + 10ms;
+  klyaksa::Timepoint fired_at{};
+  scheduler.ScheduleAt(deadline, [&]() {
+    fired_at = std::chrono::steady_clock::now();
+    fired = true;
+  });
+  while (!fired) {
+    std::this_thread::sleep_for(1ms);
+  }
+  ASSERT_GE(fired_at, deadline);
+  ASSERT_TRUE(TimeIsNear(fired_at, deadline, 5ms));
+  ASSERT_TRUE(far.Cancel());
+  scheduler.Stop();
+  pool.Stop();
+}
+
+TEST(scheduler, concurrent_producers) {
+  using namespace std::chrono_literals;
+  static constexpr int kProducers{4};
+  static constexpr int kTimers{500};
+
+  klyaksa::ThreadPool pool{2};
+  klyaksa::Scheduler scheduler{&pool};
+  pool.Start();
+  scheduler.Start();
+  std::atomic<int> fired{0};
+  std::atomic<int> cancelled{0};
+  {
+    std::vector<std::jthread> producers;
+    for (int i = 0; i < kProducers; i++) {
+      producers.emplace_back([&]() {
+        for (int j = 0; j < kTimers; j++) {
+          auto handle = scheduler.ScheduleAfter(klyaksa::Timeout{j % 10},
+                                                [&fired]() { fired++; });
+          // every other timer is a timeout which isn't needed
+          auto copy = handle;
+          if (j % 2 == 1 && copy.Cancel()) {
+            cancelled++;
+          }
+        }
+      });
+    }
+  }
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (fired + cancelled < kProducers * kTimers &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  scheduler.Stop();
+  pool.Stop();
+  ASSERT_EQ(fired + cancelled, kProducers * kTimers);
+  ASSERT_GT(cancelled, 0);
+  ASSERT_EQ(scheduler.CallbackCount(), 0);
+}
+
+TEST(scheduler, slack_keeps_timers_in_window) {
+  using namespace std::chrono_literals;
+  static constexpr int kTimers{100};
+
+  klyaksa::ThreadPool pool{2};
+  klyaksa::Scheduler scheduler{&pool};
+  pool.Start();
+  scheduler.Start();
+  std::atomic<int> early{0};
+  std::atomic<int> fired{0};
+  const auto start = std::chrono::steady_clock::now() + 20ms;
+  for (int i = 0; i < kTimers; i++) {
+    // deadlines spread over 1ms, each may be up to 10ms late
+    const auto when = start + std::chrono::microseconds{i * 10};
+    scheduler.ScheduleAt(
+        when,
+        [when, &early, &fired]() {
+          if (std::chrono::steady_clock::now() < when) {
+            early++;
+          }
+          fired++;
+        },
+        10ms);
+  }
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (fired < kTimers && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  scheduler.Stop();
+  pool.Stop();
+  ASSERT_EQ(fired, kTimers);
+  ASSERT_EQ(early, 0);
+}
+
+TEST(scheduler, staging_keeps_or_drops_late_tasks) {
+  using namespace std::chrono_literals;
+  static constexpr int kTimers{50};
+
+  for (auto policy : {klyaksa::LatePolicy::kKeep,
+                      klyaksa::LatePolicy::kDropLate}) {
+    klyaksa::ThreadPool pool{1, {.queue_capacity = 4}};
+    klyaksa::Scheduler scheduler{
+        &pool, {.late_policy = policy, .max_lateness = 10ms}};
+    pool.Start();
+    scheduler.Start();
+    // the only worker is busy while timers expire
+    std::atomic<bool> release{false};
+    ASSERT_TRUE(Dispatch(pool, [&release]() {
+      while (!release) {
+        std::this_thread::sleep_for(1ms);
+      }
+    }));
+    std::atomic<int> fired{0};
+    for (int i = 0; i < kTimers; i++) {
+      scheduler.ScheduleAfter(5ms, [&fired]() { fired++; });
+    }
+    std::this_thread::sleep_for(50ms);
+    auto stats = scheduler.Stats();
+    ASSERT_GT(stats.staged, 0u);
+    ASSERT_EQ(stats.staging_size, stats.staged);
+    ASSERT_EQ(stats.dropped, 0u);
+    release = true;
+
+    const auto deadline = std::chrono::steady_clock::now() + 10s;
+    while (fired + scheduler.Stats().dropped < kTimers &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(1ms);
+    }
+    stats = scheduler.Stats();
+    ASSERT_EQ(fired + stats.dropped, kTimers);
+    ASSERT_EQ(stats.staging_size, 0u);
+    if (policy == klyaksa::LatePolicy::kKeep) {
+      ASSERT_EQ(stats.dropped, 0u);
+    } else {
+      // the queue took a few, the rest waited longer than allowed
+      ASSERT_EQ(stats.dropped, stats.staged);
+    }
+    scheduler.Stop();
+    pool.Stop();
+  }
+}
+
+TEST(scheduler, expired_timers_honour_overflow_policy) {
+  using namespace std::chrono_literals;
+  static constexpr std::size_t kCapacity{4};
+  klyaksa::ThreadPool pool{
+      1,
+      {.queue_capacity = kCapacity,
+       .overflow_policy = klyaksa::OverflowPolicy::kDiscardOldest}};
+  klyaksa::Scheduler scheduler{&pool};
+  pool.Start();
+  scheduler.Start();
+  std::atomic<bool> release{false};
+  std::atomic<bool> running{false};
+  ASSERT_TRUE(Dispatch(pool, [&release, &running]() {
+    running = true;
+    while (!release) {
+      std::this_thread::sleep_for(1ms);
+    }
+  }));
+  while (!running) {
+    std::this_thread::yield();
+  }
+  std::vector<std::future<void>> queued;
+  for (std::size_t i = 0; i < kCapacity; i++) {
+    auto fut = Post(pool, []() {});
+    ASSERT_TRUE(fut);
+    queued.push_back(std::move(*fut));
+  }
+  // one more timed task than the queue holds: they evict the queued tasks
+  // and then the first of them
+  std::vector<std::future<void>> timed;
+  const auto when = std::chrono::steady_clock::now() + 5ms;
+  for (std::size_t i = 0; i <= kCapacity; i++) {
+    klyaksa::Task task{[]() {}};
+    timed.push_back(task.GetFuture<void>());
+    scheduler.ScheduleAt(when, std::move(task));
+  }
+  std::this_thread::sleep_for(30ms);
+  ASSERT_EQ(scheduler.Stats().staging_size, 0u);
+  release = true;
+  for (auto&& fut : queued) {
+    EXPECT_THROW(fut.get(), std::future_error);
+  }
+  EXPECT_THROW(timed.front().get(), std::future_error);
+  for (std::size_t i = 1; i <= kCapacity; i++) {
+    ASSERT_EQ(timed[i].wait_for(10s), std::future_status::ready);
+    timed[i].get();
+  }
+  scheduler.Stop();
+  pool.Stop();
+}
+
+TEST(scheduler, expired_timers_wait_for_executor_start) {
+  using namespace std::chrono_literals;
+  klyaksa::ThreadPool pool{1};
+  klyaksa::Scheduler scheduler{&pool};
+  scheduler.Start();
+  std::promise<void> fired;
+  auto done = fired.get_future();
+  scheduler.ScheduleAfter(1ms, [&fired]() { fired.set_value(); });
+  // the timer thread stages it and waits for the pool without polling it
+  std::this_thread::sleep_for(20ms);
+  ASSERT_EQ(done.wait_for(0s), std::future_status::timeout);
+  ASSERT_EQ(scheduler.Stats().staging_size, 1u);
+  pool.Start();
+  ASSERT_EQ(done.wait_for(10s), std::future_status::ready);
+  scheduler.Stop();
+  pool.Stop();
+}
+
+TEST(scheduler, late_policy_applies_to_timers_of_stopped_executor) {
+  using namespace std::chrono_literals;
+  klyaksa::ThreadPool pool{1};
+  klyaksa::Scheduler scheduler{
+      &pool,
+      {.late_policy = klyaksa::LatePolicy::kDropLate, .max_lateness = 5ms}};
+  scheduler.Start();
+  klyaksa::Task task{[]() {}};
+  auto done = task.GetFuture<void>();
+  scheduler.ScheduleAfter(1ms, std::move(task));
+  std::this_thread::sleep_for(30ms);
+  pool.Start();
+  EXPECT_THROW(done.get(), std::future_error);
+  const auto stats = scheduler.Stats();
+  EXPECT_EQ(stats.dropped, 1u);
+  EXPECT_EQ(stats.staging_size, 0u);
+  scheduler.Stop();
+  pool.Stop();
+}
+
+TEST(scheduler, schedulers_share_executor) {
+  using namespace std::chrono_literals;
+  klyaksa::ThreadPool pool{1};
+  klyaksa::Scheduler first{&pool};
+  klyaksa::Scheduler second{&pool};
+  first.Start();
+  second.Start();
+  std::promise<void> first_fired;
+  std::promise<void> second_fired;
+  first.ScheduleAfter(1ms, [&first_fired]() { first_fired.set_value(); });
+  second.ScheduleAfter(1ms, [&second_fired]() { second_fired.set_value(); });
+  std::this_thread::sleep_for(20ms);
+  // each of them has its own listener to be told about the start
+  pool.Start();
+  ASSERT_EQ(first_fired.get_future().wait_for(10s),
+            std::future_status::ready);
+  ASSERT_EQ(second_fired.get_future().wait_for(10s),
+            std::future_status::ready);
+
+  // stopping one of them leaves the listener of the other
+  first.Stop();
+  pool.Stop();
+  std::promise<void> fired_again;
+  second.ScheduleAfter(1ms, [&fired_again]() { fired_again.set_value(); });
+  std::this_thread::sleep_for(20ms);
+  pool.Start();
+  ASSERT_EQ(fired_again.get_future().wait_for(10s),
+            std::future_status::ready);
+  second.Stop();
+  pool.Stop();
+}
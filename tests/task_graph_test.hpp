@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "task_graph.hpp"
+
+TEST(task_graph, diamond_runs_in_dependency_order) {
+  for (bool work_stealing : {false, true}) {
+    klyaksa::ThreadPool executor{3, {.work_stealing = work_stealing}};
+    executor.Start();
+    // a -> (b, c) -> d
+    std::atomic<int> step{0};
+    std::array<int, 4> order{};
+    klyaksa::TaskGraph graph;
+    auto a = graph.Add([&] { order[0] = step.fetch_add(1); });
+    auto b = graph.Add([&] { order[1] = step.fetch_add(1); }, {a});
+    auto c = graph.Add([&] { order[2] = step.fetch_add(1); }, {a});
+    graph.Add([&] { order[3] = step.fetch_add(1); }, {b, c});
+    ASSERT_EQ(graph.Size(), 4u);
+    // the same graph runs many times
+    for (int run = 0; run < 100; run++) {
+      step.store(0);
+      graph.Run(executor).get();
+      ASSERT_EQ(order[0], 0);
+      ASSERT_EQ(order[3], 3);
+      ASSERT_EQ(order[1] + order[2], 3);
+    }
+    executor.Stop();
+  }
+}
+
+TEST(task_graph, wide_graph_with_full_queue) {
+  // the pool rejects most of ready nodes: they run on the thread which
+  // made them ready
+  klyaksa::ThreadPool executor{2, {.queue_capacity = 2}};
+  executor.Start();
+  static constexpr std::size_t kWidth{200};
+  std::atomic<std::size_t> sum{0};
+  klyaksa::TaskGraph graph;
+  auto root = graph.Add([] {});
+  std::vector<klyaksa::TaskGraph::NodeId> layer;
+  for (std::size_t i = 0; i < kWidth; i++) {
+    layer.push_back(graph.Add([&sum, i] { sum.fetch_add(i); }, {root}));
+  }
+  std::size_t total = 0;
+  graph.Add([&sum, &total] { total = sum.load(); }, layer);
+  for (int run = 1; run <= 3; run++) {
+    graph.Run(executor).get();
+    ASSERT_EQ(total, run * kWidth * (kWidth - 1) / 2);
+  }
+  executor.Stop();
+}
+
+TEST(task_graph, errors) {
+  klyaksa::ThreadPool executor{2};
+  executor.Start();
+  klyaksa::TaskGraph graph;
+  ASSERT_THROW(graph.Add([] {}, {0}), std::invalid_argument);
+  ASSERT_NO_THROW(graph.Run(executor).get());
+
+  std::atomic<bool> release{false};
+  std::atomic<bool> skipped{true};
+  auto slow = graph.Add([&release] { release.wait(false); });
+  auto failing =
+      graph.Add([] { throw std::runtime_error("step failed"); }, {slow});
+  graph.Add([&skipped] { skipped.store(false); }, {failing});
+  auto done = graph.Run(executor);
+  ASSERT_THROW((void)graph.Run(executor), std::logic_error);
+  release.store(true);
+  release.notify_all();
+  ASSERT_THROW(done.get(), std::runtime_error);
+  ASSERT_TRUE(skipped.load());
+  executor.Stop();
+}
+
+TEST(task_graph, dropped_node_fails_the_run) {
+  klyaksa::ThreadPool executor{
+      2, {.overflow_policy = klyaksa::OverflowPolicy::kDiscardNewest}};
+  for (std::size_t i = 0; i < executor.QueueCapacity(); i++) {
+    ASSERT_TRUE(Dispatch(executor, [] {}));
+  }
+  std::atomic<int> ran{0};
+  klyaksa::TaskGraph graph;
+  auto a = graph.Add([&ran] { ran++; });
+  graph.Add([&ran] { ran++; }, {a});
+  ASSERT_THROW(graph.Run(executor).get(), std::future_error);
+  ASSERT_EQ(ran.load(), 0);
+  // the run is over
+  ASSERT_NO_THROW(graph.Add([] {}));
+}
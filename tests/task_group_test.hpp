@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+#include "task_group.hpp"
+
+namespace {
+
+// every level waits for its children on the worker it runs on
+void FanOut(klyaksa::ThreadPool& executor, int depth,
+            std::atomic<int>& leaves) {
+  if (depth == 0) {
+    leaves.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  klyaksa::TaskGroup group{executor};
+  for (int i = 0; i < 4; i++) {
+    group.Run([&executor, depth, &leaves] {
+      FanOut(executor, depth - 1, leaves);
+    });
+  }
+  group.Wait();
+}
+
+}  // namespace
+
+TEST(task_group, nested_fan_out_does_not_deadlock) {
+  for (bool work_stealing : {false, true}) {
+    // far fewer workers than waiting tasks
+    klyaksa::ThreadPool executor{2, {.work_stealing = work_stealing}};
+    executor.Start();
+    std::atomic<int> leaves{0};
+    klyaksa::TaskGroup group{executor};
+    group.Run([&] { FanOut(executor, 4, leaves); });
+    group.Wait();
+    ASSERT_EQ(leaves.load(), 256);
+    executor.Stop();
+  }
+}
+
+TEST(task_group, wait_outside_and_reuse) {
+  klyaksa::ThreadPool executor{2};
+  executor.Start();
+  klyaksa::TaskGroup group{executor};
+  ASSERT_FALSE(executor.IsWorkerThread());
+  ASSERT_FALSE(executor.RunPendingTask());
+  std::atomic<int> sum{0};
+  for (int round = 1; round <= 3; round++) {
+    for (int i = 1; i <= 100; i++) {
+      group.Run([&sum](int value) { sum.fetch_add(value); }, i);
+    }
+    group.Wait();
+    ASSERT_EQ(sum.load(), round * 5050);
+  }
+
+  group.Run([] { throw std::runtime_error("failed"); });
+  group.Run([] {});
+  ASSERT_THROW(group.Wait(), std::runtime_error);
+  // the error is reported once
+  ASSERT_NO_THROW(group.Wait());
+  executor.Stop();
+}
+
+TEST(task_group, dropped_task_is_done) {
+  klyaksa::ThreadPool executor{
+      2, {.overflow_policy = klyaksa::OverflowPolicy::kDiscardNewest}};
+  for (std::size_t i = 0; i < executor.QueueCapacity(); i++) {
+    ASSERT_TRUE(Dispatch(executor, [] {}));
+  }
+  klyaksa::TaskGroup group{executor};
+  bool ran = false;
+  group.Run([&ran] { ran = true; });
+  ASSERT_THROW(group.Wait(), std::future_error);
+  ASSERT_FALSE(ran);
+}
@@ -314,3 +314,661 @@ TEST(thread_pool, access_future_after_executor_destruction) {
     ASSERT_EQ(fut.get(), kReturnValue);
   }
 }
+
+namespace {
+// Post `fanout` children from each task until `depth` is reached
+void FanOut(klyaksa::ThreadPool& executor, std::atomic<int>& executed,
+            int depth, int fanout) {
+  executed++;
+  if (depth == 0) {
+    return;
+  }
+  for (int i = 0; i < fanout; i++) {
+    auto child = [&executor, &executed, depth, fanout]() {
+      FanOut(executor, executed, depth - 1, fanout);
+    };
+    while (!executor.Post(klyaksa::Task{child})) {
+      std::this_thread::yield();
+    }
+  }
+}
+}  // namespace
+
+TEST(thread_pool, work_stealing_recursive_fan_out) {
+  using namespace std::chrono_literals;
+
+  static constexpr std::size_t kWorkers{4};
+  static constexpr int kDepth{4};
+  static constexpr int kFanout{6};
+  // 1 + 6 + 6^2 + 6^3 + 6^4
+  static constexpr int kExpected{1555};
+
+  klyaksa::ThreadPool executor{kWorkers, {.work_stealing = true}};
+  executor.Start();
+  std::atomic<int> executed{0};
+  auto root = Post(executor,
+                   [&]() { FanOut(executor, executed, kDepth, kFanout); });
+  ASSERT_TRUE(root);
+
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (executed != kExpected &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  ASSERT_EQ(executed, kExpected);
+  executor.Stop();
+  ASSERT_EQ(executor.GetActiveTasks(), 0);
+}
+
+TEST(thread_pool, work_stealing_external_post) {
+  static constexpr std::size_t kWorkers{3};
+  klyaksa::ThreadPool executor{kWorkers, {.work_stealing = true}};
+  executor.Start();
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 100; i++) {
+    auto fut = Post(executor, [i]() { return i * 2; });
+    ASSERT_TRUE(fut);
+    results.push_back(std::move(*fut));
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(results[i].get(), i * 2);
+  }
+  executor.Stop();
+}
+
+TEST(thread_pool, work_stealing_start_after_stop) {
+  static constexpr std::size_t kWorkers{5};
+  klyaksa::ThreadPool executor{kWorkers, {.work_stealing = true}};
+  for (std::size_t i = 0; i < 100; i++) {
+    executor.Start();
+    ASSERT_TRUE(!executor.IsStopped());
+    (void)Post(executor, [] {});
+    executor.Stop();
+    ASSERT_TRUE(executor.IsStopped());
+    ASSERT_EQ(executor.GetActiveTasks(), 0);
+  }
+}
+
+namespace {
+// fill the queue of the not started pool
+void FillQueue(klyaksa::ThreadPool& executor) {
+  for (std::size_t i = 0; i < klyaksa::ThreadPool::kTaskQueueSize; i++) {
+    ASSERT_TRUE(Post(executor, [] {}));
+  }
+}
+}  // namespace
+
+TEST(thread_pool, overflow_reject) {
+  klyaksa::ThreadPool executor{2};
+  FillQueue(executor);
+  ASSERT_FALSE(Post(executor, [] {}));
+}
+
+TEST(thread_pool, overflow_caller_runs) {
+  klyaksa::ThreadPool executor{
+      2, {.overflow_policy = klyaksa::OverflowPolicy::kCallerRuns}};
+  FillQueue(executor);
+  std::thread::id runner;
+  auto fut =
+      Post(executor, [&runner] { runner = std::this_thread::get_id(); });
+  ASSERT_TRUE(fut);
+  ASSERT_EQ(fut->wait_for(std::chrono::seconds{0}), std::future_status::ready);
+  ASSERT_EQ(runner, std::this_thread::get_id());
+}
+
+TEST(thread_pool, overflow_discard_newest) {
+  klyaksa::ThreadPool executor{
+      2, {.overflow_policy = klyaksa::OverflowPolicy::kDiscardNewest}};
+  FillQueue(executor);
+  auto fut = Post(executor, [] { return 1; });
+  ASSERT_TRUE(fut);
+  EXPECT_THROW(fut->get(), std::future_error);
+}
+
+TEST(thread_pool, overflow_discard_oldest) {
+  klyaksa::ThreadPool executor{
+      2, {.overflow_policy = klyaksa::OverflowPolicy::kDiscardOldest}};
+  auto oldest = Post(executor, [] { return 1; });
+  ASSERT_TRUE(oldest);
+  for (std::size_t i = 1; i < klyaksa::ThreadPool::kTaskQueueSize; i++) {
+    ASSERT_TRUE(Post(executor, [] {}));
+  }
+  auto newest = Post(executor, [] { return 2; });
+  ASSERT_TRUE(newest);
+  EXPECT_THROW(oldest->get(), std::future_error);
+  executor.Start();
+  EXPECT_EQ(newest->get(), 2);
+  executor.Stop();
+}
+
+TEST(thread_pool, overflow_block) {
+  using namespace std::chrono_literals;
+  {
+    klyaksa::ThreadPool executor{
+        2, {.overflow_policy = klyaksa::OverflowPolicy::kBlock,
+            .block_timeout = 20ms}};
+    FillQueue(executor);
+    // nobody drains the queue: timeout expires
+    const auto start = std::chrono::steady_clock::now();
+    ASSERT_FALSE(Post(executor, [] {}));
+    ASSERT_GE(std::chrono::steady_clock::now() - start, 20ms);
+  }
+  klyaksa::ThreadPool executor{
+      2, {.overflow_policy = klyaksa::OverflowPolicy::kBlock,
+          .block_timeout = 10s}};
+  FillQueue(executor);
+  // workers free the slot while the producer is blocked
+  std::optional<std::future<int>> blocked;
+  std::jthread producer{
+      [&]() { blocked = Post(executor, [] { return 3; }); }};
+  std::this_thread::sleep_for(10ms);
+  executor.Start();
+  producer.join();
+  ASSERT_TRUE(blocked);
+  EXPECT_EQ(blocked->get(), 3);
+  executor.Stop();
+}
+
+TEST(thread_pool, runtime_queue_capacity) {
+  klyaksa::ThreadPool executor{2, {.queue_capacity = 4}};
+  ASSERT_EQ(executor.QueueCapacity(), 4u);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(Post(executor, [] {}));
+  }
+  ASSERT_FALSE(Post(executor, [] {}));
+}
+
+#ifndef KLYAKSA_LOCK_FREE_QUEUE
+TEST(thread_pool, unbounded_queue_burst) {
+  static constexpr int kTasks{100'000};
+  klyaksa::ThreadPool executor{
+      2, {.queue_capacity = klyaksa::kUnboundedQueue}};
+  std::atomic<int> done{0};
+  for (int i = 0; i < kTasks; i++) {
+    ASSERT_TRUE(Post(executor, [&done] { done++; }));
+  }
+  executor.Start();
+  while (done.load() < kTasks) {
+    std::this_thread::yield();
+  }
+  executor.Stop();
+}
+#else
+TEST(thread_pool, unbounded_queue_burst) {
+  // the lock-free queue needs a fixed ring
+  const klyaksa::ThreadPoolOptions options{
+      .queue_capacity = klyaksa::kUnboundedQueue};
+  EXPECT_THROW(klyaksa::ThreadPool(2, options), std::invalid_argument);
+}
+#endif  // KLYAKSA_LOCK_FREE_QUEUE
+
+TEST(thread_pool, dispatch) {
+  using namespace std::chrono_literals;
+  klyaksa::ThreadPool executor{2};
+  executor.Start();
+
+  std::promise<int> sum;
+  auto fut = sum.get_future();
+  ASSERT_TRUE(Dispatch(
+      executor, [](std::promise<int>& p, int a, int b) { p.set_value(a + b); },
+      std::ref(sum), 1, 2));
+  ASSERT_EQ(fut.get(), 3);
+
+  // exception of a detached task is swallowed by the pool
+  ASSERT_TRUE(Dispatch(executor, [] { throw std::runtime_error("oops"); }));
+  // a capture which doesn't fit the small buffer goes to the heap
+  std::array<std::uint64_t, 16> payload{};
+  payload.back() = 42;
+  ASSERT_FALSE(klyaksa::SmallFunction::IsInplace<decltype([payload] {})>());
+  std::promise<std::uint64_t> last;
+  ASSERT_TRUE(Dispatch(executor, [payload, &last] {
+    last.set_value(payload.back());
+  }));
+  ASSERT_EQ(last.get_future().get(), 42u);
+
+  executor.Stop();
+  ASSERT_EQ(executor.GetActiveTasks(), 0);
+  EXPECT_THROW(klyaksa::Task::Detached([] {}).GetFuture<void>(),
+               std::runtime_error);
+}
+
+TEST(thread_pool, post_batch) {
+  static constexpr std::size_t kCapacity{4};
+  klyaksa::ThreadPool executor{2, {.queue_capacity = kCapacity}};
+  std::vector<klyaksa::Task> tasks;
+  std::vector<std::future<std::size_t>> results;
+  for (std::size_t i = 0; i < kCapacity + 2; i++) {
+    tasks.emplace_back([i] { return i; });
+    results.push_back(tasks.back().GetFuture<std::size_t>());
+  }
+  ASSERT_EQ(executor.PostBatch(tasks), kCapacity);
+  executor.Start();
+  for (std::size_t i = 0; i < kCapacity; i++) {
+    ASSERT_EQ(results[i].get(), i);
+  }
+  // rejected tasks are still usable
+  ASSERT_EQ(executor.PostBatch(std::span{tasks}.last(2)), 2u);
+  ASSERT_EQ(results[kCapacity].get(), kCapacity);
+  ASSERT_EQ(results[kCapacity + 1].get(), kCapacity + 1);
+  executor.Stop();
+}
+
+TEST(thread_pool, idle_strategy) {
+  const klyaksa::IdleStrategy strategies[] = {
+      {.spin = 100},
+      {.spin = 100, .yield = 10},
+      {.spin = 1000, .adaptive = true},
+  };
+  for (bool work_stealing : {false, true}) {
+    for (auto&& idle : strategies) {
+      klyaksa::ThreadPool executor{
+          2, {.work_stealing = work_stealing, .idle = idle}};
+      executor.Start();
+      for (int burst = 0; burst < 10; burst++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        auto fut = Post(executor, [burst] { return burst; });
+        ASSERT_TRUE(fut);
+        ASSERT_EQ(fut->get(), burst);
+      }
+      executor.Stop();
+    }
+  }
+}
+
+TEST(thread_pool, snapshot_statistics) {
+  using namespace std::chrono_literals;
+  static constexpr int kTasks{50};
+  klyaksa::ThreadPool executor{2, {.collect_timings = true}};
+  executor.Start();
+  std::vector<std::future<void>> results;
+  for (int i = 0; i < kTasks; i++) {
+    auto fut = Post(executor, [] { std::this_thread::sleep_for(100us); });
+    ASSERT_TRUE(fut);
+    results.push_back(std::move(*fut));
+  }
+  for (auto&& result : results) {
+    result.get();
+  }
+  executor.Stop();
+
+  const auto stats = executor.Snapshot();
+  ASSERT_EQ(stats.workers.size(), 2u);
+  EXPECT_EQ(stats.total.executed, static_cast<std::uint64_t>(kTasks));
+  EXPECT_EQ(stats.total.execution.Count(), static_cast<std::uint64_t>(kTasks));
+  EXPECT_EQ(stats.total.queue_wait.Count(), static_cast<std::uint64_t>(kTasks));
+  EXPECT_GE(stats.total.execution.Percentile(50), 100'000u);
+  EXPECT_GE(stats.total.busy, 100us * kTasks);
+  EXPECT_EQ(stats.queue_capacity, klyaksa::kDefaultQueueCapacity);
+  EXPECT_EQ(stats.overflows, 0u);
+}
+
+TEST(thread_pool, parks_and_nested_tasks_counted_once) {
+  using namespace std::chrono_literals;
+  static constexpr int kTasks{100};
+  for (bool work_stealing : {false, true}) {
+    klyaksa::ThreadPool executor{
+        1, {.work_stealing = work_stealing, .collect_timings = true}};
+    executor.Start();
+    std::promise<void> release;
+    auto blocker =
+        Post(executor, [gate = release.get_future()] { gate.wait(); });
+    ASSERT_TRUE(blocker);
+    std::vector<std::future<void>> results;
+    for (int i = 0; i < kTasks; i++) {
+      auto fut = Post(executor, [] {});
+      ASSERT_TRUE(fut);
+      results.push_back(std::move(*fut));
+    }
+    release.set_value();
+    for (auto&& result : results) {
+      result.get();
+    }
+    // a worker which finds a task right away doesn't park
+    EXPECT_LE(executor.Snapshot().total.parks, 3u);
+
+    // the inner task runs within the busy time of the outer one
+    std::chrono::steady_clock::duration outer{};
+    auto nested = Post(executor, [&executor, &outer] {
+      const auto start = std::chrono::steady_clock::now();
+      ASSERT_TRUE(
+          Dispatch(executor, [] { std::this_thread::sleep_for(20ms); }));
+      ASSERT_TRUE(executor.RunPendingTask());
+      outer = std::chrono::steady_clock::now() - start;
+    });
+    ASSERT_TRUE(nested);
+    nested->get();
+    executor.Stop();
+    const auto stats = executor.Snapshot().total;
+    EXPECT_EQ(stats.executed, static_cast<std::uint64_t>(kTasks) + 3);
+    EXPECT_EQ(stats.execution.Count(), static_cast<std::uint64_t>(kTasks) + 2);
+    EXPECT_GE(stats.busy, 20ms);
+    EXPECT_LT(stats.busy, outer + 20ms);
+  }
+}
+
+TEST(thread_pool, histogram_buckets) {
+  using Snapshot = klyaksa::HistogramSnapshot;
+  for (std::uint64_t value : {0ull, 7ull, 8ull, 1000ull, 123456789ull,
+                              ~0ull}) {
+    const auto bucket = Snapshot::BucketOf(value);
+    ASSERT_LT(bucket, Snapshot::kBuckets);
+    ASSERT_LE(Snapshot::LowerBound(bucket), value);
+    if (bucket + 1 < Snapshot::kBuckets) {
+      ASSERT_GT(Snapshot::LowerBound(bucket + 1), value);
+    }
+  }
+  klyaksa::Histogram histogram;
+  for (std::uint64_t i = 1; i <= 100; i++) {
+    histogram.Record(i * 1000);
+  }
+  const auto snapshot = histogram.Snapshot();
+  ASSERT_EQ(snapshot.Count(), 100u);
+  ASSERT_EQ(snapshot.max, 100'000u);
+  // 1/8 relative error
+  ASSERT_NEAR(static_cast<double>(snapshot.Percentile(50)), 50'000, 6'250);
+}
+
+TEST(thread_pool, priority_lanes) {
+  using klyaksa::Priority;
+  const auto now = std::chrono::steady_clock::now();
+  for (bool work_stealing : {false, true}) {
+    // no aging: tasks go in priority and deadline order
+    klyaksa::ThreadPool executor{
+        1, {.work_stealing = work_stealing,
+            .priority_aging = std::chrono::hours{1}}};
+    // a stopped pool doesn't take lane tasks
+    ASSERT_FALSE(Dispatch(executor, Priority::kHigh, [] {}));
+    executor.Start();
+    // the only worker waits until everything is queued
+    std::promise<void> release;
+    std::atomic<bool> blocked{false};
+    ASSERT_TRUE(Dispatch(executor, [gate = release.get_future(), &blocked] {
+      blocked = true;
+      gate.wait();
+    }));
+    while (!blocked) {
+      std::this_thread::yield();
+    }
+    std::vector<int> order;
+    auto record = [&order](int id) { order.push_back(id); };
+    ASSERT_TRUE(Dispatch(executor, Priority::kLow, record, 6));
+    ASSERT_TRUE(Dispatch(executor, record, 4));
+    ASSERT_TRUE(Dispatch(executor, Priority::kHigh,
+                         now + std::chrono::seconds{2}, record, 2));
+    ASSERT_TRUE(Dispatch(executor, record, 5));
+    ASSERT_TRUE(Dispatch(executor, Priority::kHigh, record, 3));
+    auto last = Post(executor, Priority::kLow, [&order] {
+      order.push_back(7);
+      return order.size();
+    });
+    ASSERT_TRUE(last);
+    ASSERT_TRUE(Dispatch(executor, Priority::kHigh,
+                         now + std::chrono::seconds{1}, record, 1));
+    EXPECT_EQ(executor.Snapshot().lane_size, 5u);
+    release.set_value();
+    ASSERT_EQ(last->get(), 7u);
+    executor.Stop();
+    ASSERT_EQ(order, (std::vector<int>{1, 2, 3, 4, 5, 6, 7}));
+    ASSERT_EQ(executor.Snapshot().lane_size, 0u);
+  }
+}
+
+TEST(thread_pool, priority_aging) {
+  using klyaksa::Priority;
+  klyaksa::ThreadPool executor{
+      1, {.priority_aging = std::chrono::milliseconds{1}}};
+  executor.Start();
+  std::promise<void> release;
+  std::atomic<bool> blocked{false};
+  ASSERT_TRUE(Dispatch(executor, [gate = release.get_future(), &blocked] {
+    blocked = true;
+    gate.wait();
+  }));
+  while (!blocked) {
+    std::this_thread::yield();
+  }
+  std::vector<int> order;
+  auto record = [&order](int id) { order.push_back(id); };
+  auto low = Post(executor, Priority::kLow, record, 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds{5});
+  auto high = Post(executor, Priority::kHigh, record, 2);
+  std::this_thread::sleep_for(std::chrono::milliseconds{5});
+  ASSERT_TRUE(low && high);
+  // both lanes reached the top level: the one waiting longer goes first
+  release.set_value();
+  low->get();
+  high->get();
+  executor.Stop();
+  ASSERT_EQ(order, (std::vector<int>{1, 2}));
+}
+
+TEST(thread_pool, lane_posts_leave_queue_free) {
+  klyaksa::ThreadPool executor{1};
+  executor.Start();
+  std::promise<void> release;
+  auto blocker = Post(executor, [gate = release.get_future()] { gate.wait(); });
+  ASSERT_TRUE(blocker);
+  std::atomic<std::size_t> ran{0};
+  for (std::size_t i = 0; i < executor.QueueCapacity(); i++) {
+    ASSERT_TRUE(Dispatch(executor, klyaksa::Priority::kLow,
+                         [&ran] { ran.fetch_add(1); }));
+  }
+  // lane posts don't take slots of the shared queue
+  auto fut = Post(executor, [] { return 1; });
+  ASSERT_TRUE(fut);
+  release.set_value();
+  EXPECT_EQ(fut->get(), 1);
+  while (ran.load() != executor.QueueCapacity()) {
+    std::this_thread::yield();
+  }
+  executor.Stop();
+}
+
+TEST(thread_pool, lanes_honour_overflow_policy) {
+  using klyaksa::OverflowPolicy;
+  using klyaksa::Priority;
+  static constexpr std::size_t kCapacity{4};
+  for (auto policy : {OverflowPolicy::kReject, OverflowPolicy::kDiscardOldest,
+                      OverflowPolicy::kCallerRuns}) {
+    klyaksa::ThreadPool executor{
+        1, {.queue_capacity = kCapacity, .overflow_policy = policy}};
+    executor.Start();
+    std::promise<void> release;
+    std::atomic<bool> blocked{false};
+    ASSERT_TRUE(Dispatch(executor, [gate = release.get_future(), &blocked] {
+      blocked = true;
+      gate.wait();
+    }));
+    while (!blocked) {
+      std::this_thread::yield();
+    }
+    std::vector<std::future<std::thread::id>> queued;
+    for (std::size_t i = 0; i < kCapacity; i++) {
+      auto fut = Post(executor, Priority::kLow,
+                      [] { return std::this_thread::get_id(); });
+      ASSERT_TRUE(fut);
+      queued.push_back(std::move(*fut));
+    }
+    ASSERT_EQ(executor.Snapshot().lane_size, kCapacity);
+    auto extra = Post(executor, Priority::kHigh,
+                      [] { return std::this_thread::get_id(); });
+    ASSERT_EQ(executor.Snapshot().lane_size, kCapacity);
+    switch (policy) {
+      case OverflowPolicy::kReject:
+        ASSERT_FALSE(extra);
+        break;
+      case OverflowPolicy::kDiscardOldest:
+        ASSERT_TRUE(extra);
+        EXPECT_THROW(queued.front().get(), std::future_error);
+        queued.erase(queued.begin());
+        break;
+      default:
+        ASSERT_TRUE(extra);
+        ASSERT_EQ(extra->get(), std::this_thread::get_id());
+        break;
+    }
+    release.set_value();
+    for (auto&& fut : queued) {
+      ASSERT_NE(fut.get(), std::this_thread::get_id());
+    }
+    if (extra && policy != OverflowPolicy::kCallerRuns) {
+      ASSERT_NE(extra->get(), std::this_thread::get_id());
+    }
+    executor.Stop();
+  }
+}
+
+TEST(thread_pool, elastic_workers) {
+  using namespace std::chrono_literals;
+  for (bool work_stealing : {false, true}) {
+    klyaksa::ThreadPool executor{1,
+                                 {.work_stealing = work_stealing,
+                                  .elastic = {.max_workers = 3,
+                                              .queue_depth = 2,
+                                              .queue_age = 1us,
+                                              .keep_alive = 20ms}}};
+    executor.Start();
+    ASSERT_EQ(executor.LiveWorkers(), 1u);
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 50; i++) {
+      auto fut = Post(executor, [i] {
+        std::this_thread::sleep_for(1ms);
+        return i;
+      });
+      ASSERT_TRUE(fut);
+      results.push_back(std::move(*fut));
+    }
+    for (int i = 0; i < 50; i++) {
+      ASSERT_EQ(results[i].get(), i);
+    }
+    auto stats = executor.Snapshot();
+    ASSERT_GE(stats.grown, 1u);
+    ASSERT_LE(stats.grown - stats.retired, 2u);
+    ASSERT_EQ(stats.workers.size(), 3u);
+    // added workers retire after the keep-alive period
+    for (int i = 0; i < 100 && executor.LiveWorkers() > 1; i++) {
+      std::this_thread::sleep_for(10ms);
+    }
+    stats = executor.Snapshot();
+    ASSERT_EQ(stats.live_workers, 1u);
+    ASSERT_EQ(stats.retired, stats.grown);
+    // a retired slot can be started again
+    auto fut = Post(executor, [] { return 1; });
+    ASSERT_TRUE(fut);
+    ASSERT_EQ(fut->get(), 1);
+    executor.Stop();
+    ASSERT_EQ(executor.LiveWorkers(), 0u);
+  }
+}
+
+TEST(thread_pool, cancel_queued_and_running) {
+  klyaksa::ThreadPool executor{1};
+  executor.Start();
+  std::stop_source source;
+  std::atomic<bool> started{false};
+  auto running = Post(executor, source.get_token(),
+                      [&started](std::stop_token token) {
+                        started = true;
+                        while (!token.stop_requested()) {
+                          std::this_thread::yield();
+                        }
+                        return 1;
+                      });
+  std::atomic<bool> ran{false};
+  auto queued = Post(executor, source.get_token(), [&ran] { ran = true; });
+  auto with_args = Post(
+      executor, std::stop_token{},
+      [](std::stop_token, int value) { return value; }, 2);
+  ASSERT_TRUE(running && queued && with_args);
+  while (!started) {
+    std::this_thread::yield();
+  }
+  source.request_stop();
+  EXPECT_EQ(running->get(), 1);
+  EXPECT_THROW(queued->get(), klyaksa::TaskCancelled);
+  EXPECT_EQ(with_args->get(), 2);
+
+  ASSERT_TRUE(Dispatch(executor, source.get_token(), [&ran] { ran = true; }));
+  auto last = Post(executor, [] {});
+  ASSERT_TRUE(last);
+  last->get();
+  EXPECT_FALSE(ran);
+  executor.Stop();
+}
+
+TEST(thread_pool, stop_drain) {
+  for (bool work_stealing : {false, true}) {
+    klyaksa::ThreadPool executor{2, {.work_stealing = work_stealing}};
+    std::atomic<int> done{0};
+    for (int i = 0; i < 100; i++) {
+      ASSERT_TRUE(Dispatch(executor, [&executor, &done] {
+        // posted while the pool drains
+        (void)Dispatch(executor, [&done] { done.fetch_add(1); });
+        done.fetch_add(1);
+      }));
+    }
+    executor.Start();
+    ASSERT_TRUE(executor.Stop(klyaksa::StopMode::kDrain));
+    ASSERT_TRUE(executor.IsStopped());
+    ASSERT_EQ(done.load(), 200);
+    ASSERT_TRUE(executor.GetStopToken().stop_requested());
+
+    // a restarted pool has a fresh token
+    executor.Start();
+    ASSERT_FALSE(executor.GetStopToken().stop_requested());
+    executor.Stop();
+  }
+}
+
+TEST(thread_pool, stop_discard) {
+  klyaksa::ThreadPool executor{1};
+  executor.Start();
+  std::atomic<bool> started{false};
+  auto running = Post(executor, executor.GetStopToken(),
+                      [&started](std::stop_token token) {
+                        started = true;
+                        while (!token.stop_requested()) {
+                          std::this_thread::yield();
+                        }
+                      });
+  ASSERT_TRUE(running);
+  std::atomic<int> ran{0};
+  std::vector<std::future<void>> queued;
+  for (int i = 0; i < 10; i++) {
+    auto fut = Post(executor, [&ran] { ran.fetch_add(1); });
+    ASSERT_TRUE(fut);
+    queued.push_back(std::move(*fut));
+  }
+  while (!started) {
+    std::this_thread::yield();
+  }
+  ASSERT_TRUE(executor.Stop(klyaksa::StopMode::kDiscard));
+  EXPECT_NO_THROW(running->get());
+  for (auto&& fut : queued) {
+    EXPECT_THROW(fut.get(), std::future_error);
+  }
+  EXPECT_EQ(ran.load(), 0);
+}
+
+TEST(thread_pool, stop_drain_timeout) {
+  using namespace std::chrono_literals;
+  klyaksa::ThreadPool executor{1, {.work_stealing = true}};
+  executor.Start();
+  std::atomic<bool> started{false};
+  auto running = Post(executor, executor.GetStopToken(),
+                      [&started](std::stop_token token) {
+                        started = true;
+                        while (!token.stop_requested()) {
+                          std::this_thread::yield();
+                        }
+                      });
+  auto queued = Post(executor, [] {});
+  ASSERT_TRUE(running && queued);
+  while (!started) {
+    std::this_thread::yield();
+  }
+  // the running task waits for the stop: the drain can't finish
+  ASSERT_FALSE(executor.Stop(klyaksa::StopMode::kDrain, 20ms));
+  EXPECT_NO_THROW(running->get());
+  EXPECT_THROW(queued->get(), std::future_error);
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "gtest/gtest.h"
+#include "scheduler.hpp"
+#include "thread_pool.hpp"
+#include "timer_queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+// timer which reports its deadline index when fired
+klyaksa::Task Marker(std::vector<int>& fired, int id) {
+  return klyaksa::Task::Detached([&fired, id] { fired.push_back(id); });
+}
+}  // namespace
+
+TEST(timer_queue, map_pops_in_deadline_order) {
+  using namespace std::chrono_literals;
+  klyaksa::MapTimerQueue timers;
+  const auto origin = std::chrono::steady_clock::now();
+  std::vector<int> fired;
+  timers.Insert(origin + 3ms, Marker(fired, 3));
+  timers.Insert(origin + 1ms, Marker(fired, 1));
+  timers.Insert(origin + 2ms, Marker(fired, 2));
+  ASSERT_EQ(timers.NextDeadline(), origin + 1ms);
+
+  std::vector<klyaksa::ExpiredTimer> expired;
+  timers.PopExpired(origin + 2ms, expired);
+  ASSERT_EQ(expired.size(), 2u);
+  ASSERT_EQ(timers.Size(), 1u);
+  for (auto&& timer : expired) {
+    timer.task();
+  }
+  ASSERT_EQ(fired, (std::vector<int>{1, 2}));
+}
+
+TEST(timer_queue, wheel_fires_on_time_across_levels) {
+  using namespace std::chrono_literals;
+  const auto origin = std::chrono::steady_clock::now();
+  klyaksa::WheelTimerQueue timers{1ms, origin};
+  // below the first level, in the second, in the third and out of reach
+  const std::vector<std::chrono::milliseconds> delays{
+      0ms, 5ms, 255ms, 256ms, 300ms, 70'000ms, 20'000'000ms};
+  std::vector<int> fired;
+  for (int i = static_cast<int>(delays.size()) - 1; i >= 0; i--) {
+    timers.Insert(origin + delays[i], Marker(fired, i));
+  }
+  ASSERT_EQ(timers.Size(), delays.size());
+
+  std::vector<klyaksa::ExpiredTimer> expired;
+  for (std::size_t i = 0; i < delays.size(); i++) {
+    // a moment earlier nothing fires
+    if (delays[i] > 0ms) {
+      timers.PopExpired(origin + delays[i] - 1ms, expired);
+      ASSERT_TRUE(expired.empty()) << "timer " << i << " fired early";
+      const auto next = timers.NextDeadline();
+      ASSERT_TRUE(next);
+      ASSERT_LE(*next, origin + delays[i]);
+    }
+    timers.PopExpired(origin + delays[i], expired);
+    ASSERT_EQ(expired.size(), 1u) << "timer " << i << " is late";
+    ASSERT_EQ(expired.front().deadline, origin + delays[i]);
+    expired.front().task();
+    expired.clear();
+  }
+  ASSERT_EQ(timers.Size(), 0u);
+  ASSERT_FALSE(timers.NextDeadline());
+  ASSERT_EQ(fired, (std::vector<int>{0, 1, 2, 3, 4, 5, 6}));
+}
+
+TEST(timer_queue, wheel_rounds_deadline_up_to_tick) {
+  using namespace std::chrono_literals;
+  const auto origin = std::chrono::steady_clock::now();
+  klyaksa::WheelTimerQueue timers{10ms, origin};
+  std::vector<int> fired;
+  timers.Insert(origin + 11ms, Marker(fired, 0));
+  std::vector<klyaksa::ExpiredTimer> expired;
+  timers.PopExpired(origin + 19ms, expired);
+  ASSERT_TRUE(expired.empty());
+  timers.PopExpired(origin + 20ms, expired);
+  ASSERT_EQ(expired.size(), 1u);
+}
+
+TEST(timer_queue, wheel_pops_in_deadline_order) {
+  using namespace std::chrono_literals;
+  const auto origin = std::chrono::steady_clock::now();
+  klyaksa::WheelTimerQueue timers{10ms, origin};
+  std::vector<int> fired;
+  // all of them share a tick
+  timers.Insert(origin + 9ms, Marker(fired, 3));
+  timers.Insert(origin + 3ms, Marker(fired, 1));
+  timers.Insert(origin + 6ms, Marker(fired, 2));
+  timers.Insert(origin + 3ms, Marker(fired, 4));
+  std::vector<klyaksa::ExpiredTimer> expired;
+  timers.PopExpired(origin + 10ms, expired);
+  ASSERT_EQ(expired.size(), 4u);
+  for (auto&& timer : expired) {
+    timer.task();
+  }
+  ASSERT_EQ(fired, (std::vector<int>{1, 4, 2, 3}));
+}
+
+TEST(timer_queue, cancel_and_reschedule) {
+  using namespace std::chrono_literals;
+  for (auto backend :
+       {klyaksa::TimerBackend::kMap, klyaksa::TimerBackend::kWheel}) {
+    auto timers = klyaksa::MakeTimerQueue(backend, 1ms);
+    const auto origin = std::chrono::steady_clock::now();
+    std::vector<int> fired;
+    const auto first = timers->Insert(origin + 10ms, Marker(fired, 1));
+    const auto second = timers->Insert(origin + 20ms, Marker(fired, 2));
+    const auto third = timers->Insert(origin + 300ms, Marker(fired, 3));
+
+    ASSERT_TRUE(timers->Cancel(second));
+    ASSERT_FALSE(timers->Cancel(second));
+    ASSERT_EQ(timers->Size(), 2u);
+    // the entry of the cancelled timer is reused, the old id is stale
+    const auto fourth = timers->Insert(origin + 20ms, Marker(fired, 4));
+    ASSERT_FALSE(timers->Reschedule(second, origin + 1ms));
+    // earlier and later
+    ASSERT_TRUE(timers->Reschedule(third, origin + 5ms));
+    ASSERT_TRUE(timers->Reschedule(first, origin + 30ms));
+
+    std::vector<klyaksa::ExpiredTimer> expired;
+    // the wheel may be a tick late
+    timers->PopExpired(origin + 31ms, expired);
+    ASSERT_EQ(expired.size(), 3u);
+    for (auto&& timer : expired) {
+      timer.task();
+    }
+    ASSERT_EQ(fired, (std::vector<int>{3, 4, 1}));
+    ASSERT_FALSE(timers->Cancel(fourth));
+    ASSERT_EQ(timers->Size(), 0u);
+    ASSERT_FALSE(timers->NextDeadline());
+  }
+}
+
+TEST(timer_queue, coalesce_deadlines) {
+  using namespace std::chrono_literals;
+  const auto origin = std::chrono::steady_clock::now();
+  ASSERT_EQ(klyaksa::CoalesceDeadline(origin, 0ms), origin);
+  std::set<klyaksa::Timepoint> coalesced;
+  for (int i = 0; i < 1000; i++) {
+    const auto deadline = origin + std::chrono::microseconds{i};
+    const auto when = klyaksa::CoalesceDeadline(deadline, 5ms);
+    ASSERT_GE(when, deadline);
+    ASSERT_LE(when, deadline + 5ms);
+    coalesced.insert(when);
+  }
+  // windows overlap: a power of two above 4ms fits into each of them
+  ASSERT_LE(coalesced.size(), 2u);
+}
+
+TEST(timer_queue, scheduler_with_wheel) {
+  using namespace std::chrono_literals;
+  klyaksa::ThreadPool pool{2};
+  klyaksa::Scheduler scheduler{
+      &pool, {.backend = klyaksa::TimerBackend::kWheel, .tick = 1ms}};
+  std::atomic<int> counter{0};
+  pool.Start();
+  scheduler.Start();
+  for (int i = 0; i < 100; i++) {
+    scheduler.ScheduleAfter(klyaksa::Timeout{i % 20},
+                            [&counter]() { counter++; });
+  }
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (counter < 100 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(1ms);
+  }
+  scheduler.Stop();
+  pool.Stop();
+  ASSERT_EQ(counter, 100);
+  ASSERT_EQ(scheduler.CallbackCount(), 0u);
+}
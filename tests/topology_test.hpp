@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+
+#include "gtest/gtest.h"
+#include "thread_pool.hpp"
+#include "topology.hpp"
+
+namespace {
+
+// 2 nodes x 2 cores x 2 hyper-threads, siblings are numbered like on Linux
+klyaksa::CpuTopology TwoNodeTopology() {
+  klyaksa::CpuTopology topology;
+  for (int cpu = 0; cpu < 8; cpu++) {
+    const int core = cpu % 4;
+    const int node = core / 2;
+    topology.cpus.push_back(
+        {.cpu = cpu, .core = core, .package = node, .node = node});
+  }
+  return topology;
+}
+
+}  // namespace
+
+TEST(topology, parse_cpu_list) {
+  using klyaksa::ParseCpuList;
+  ASSERT_EQ(ParseCpuList("0-3,8,10-11\n"),
+            (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+  ASSERT_EQ(ParseCpuList("5"), (std::vector<int>{5}));
+  ASSERT_TRUE(ParseCpuList("").empty());
+  ASSERT_TRUE(ParseCpuList("3-1").empty());
+  ASSERT_TRUE(ParseCpuList("1;2").empty());
+}
+
+TEST(topology, place_workers) {
+  using klyaksa::WorkerPlacement;
+  const auto topology = TwoNodeTopology();
+  auto cpus_of = [&topology](WorkerPlacement placement, std::size_t workers,
+                             std::vector<int> allowed = {}) {
+    std::vector<int> cpus;
+    for (auto&& set : PlaceWorkers(topology, placement, allowed, workers)) {
+      EXPECT_EQ(set.size(), 1u);
+      cpus.push_back(set.front());
+    }
+    return cpus;
+  };
+  // nodes in turn, a hyper-thread sibling only when cores run out
+  ASSERT_EQ(cpus_of(WorkerPlacement::kSpread, 8),
+            (std::vector<int>{0, 2, 1, 3, 4, 6, 5, 7}));
+  // fill a core, then a node
+  ASSERT_EQ(cpus_of(WorkerPlacement::kPack, 4),
+            (std::vector<int>{0, 4, 1, 5}));
+  // restricted set, reused round-robin
+  ASSERT_EQ(cpus_of(WorkerPlacement::kSpread, 3, {2, 3}),
+            (std::vector<int>{2, 3, 2}));
+  const auto any = PlaceWorkers(topology, WorkerPlacement::kNone, {}, 2);
+  ASSERT_EQ(any.size(), 2u);
+  ASSERT_TRUE(any[0].empty());
+}
+
+TEST(topology, pinned_workers_with_node_queues) {
+  const auto topology = klyaksa::CpuTopology::Detect();
+  ASSERT_FALSE(topology.cpus.empty());
+  klyaksa::ThreadPool executor{
+      2,
+      {.work_stealing = true,
+       .placement = klyaksa::WorkerPlacement::kSpread,
+       .numa_queues = true}};
+  executor.Start();
+  static constexpr int kTasks{100};
+  std::atomic<int> foreign{0};
+  std::vector<std::future<void>> results;
+  for (int i = 0; i < kTasks; i++) {
+    auto fut = Post(executor, [&topology, &foreign] {
+      if (topology.NodeOf(klyaksa::CurrentCpu()) < 0) {
+        foreign.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+    ASSERT_TRUE(fut);
+    results.push_back(std::move(*fut));
+  }
+  for (auto&& result : results) {
+    result.get();
+  }
+  executor.Stop();
+  ASSERT_EQ(foreign.load(), 0);
+  ASSERT_EQ(executor.Snapshot().total.executed,
+            static_cast<std::uint64_t>(kTasks));
+}